@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+#
+# ramp_calc.py -- generate a brightness table for the Convoy firmware
+#
+# usage: ramp_calc.py levels shape [chips [floor [phase [frac]]]]
+#
+#   levels  number of brightness levels (not counting off)
+#   shape   linear, x2, x3, x5, log or cie
+#   chips   number of 7135 chips on the driver (default 8)
+#   floor   PWM value for the lowest level (default 1), this can be
+#           a fraction when frac is given
+#   phase   levels with a PWM value below this use phase correct
+#           PWM, the rest use fast PWM (default 8)
+#   frac    bits of fraction in each value, for firmware that
+#           dithers the PWM (USE_PWM_DITHER wants 4), default 0
+#
+# "cie" spaces the levels evenly in perceived brightness (CIE 1931
+# lightness), which is usually what you want.  "log" is a plain
+# geometric series, the powers are the old ToyKeeper x**N curves.
+#
+# It writes a header on stdout with:
+#
+#   RAMP_SIZE           number of levels
+#   RAMP_PWM            the PWM values, lowest first, for a PROGMEM table
+#   RAMP_PHASE_LEVELS   levels 1 .. this many use phase correct PWM
+#   RAMP_FRAC_BITS      frac, so 255 full on is RAMP_PWM 255 << frac
+#
+# plus a comment with the duty and current for each level.
+# The firmware Makefiles run it when RAMP_ARGS is set.
+#
+# Copyright (C) 2026 the contributors to this repository (see git log)
+
+import sys
+
+MA_PER_CHIP = 350
+
+def usage():
+    sys.stderr.write("usage: ramp_calc.py levels shape [chips [floor [phase [frac]]]]\n")
+    sys.stderr.write("  shape is one of: linear x2 x3 x5 log cie\n")
+    sys.exit(1)
+
+# CIE 1931 lightness (0 to 100) to relative luminance (0 to 1) and back
+def cie_to_lum(l):
+    if l <= 8:
+        return l / 903.3
+    return ((l + 16) / 116.0) ** 3
+
+def lum_to_cie(y):
+    if y <= 0.008856:
+        return y * 903.3
+    return 116.0 * y ** (1 / 3.0) - 16
+
+# Output fraction (0 to 1) for step i of n, starting at lo
+def curve(shape, i, n, lo):
+    t = i / float(n - 1)
+    if shape == "linear":
+        return lo + (1 - lo) * t
+    if shape in ("x2", "x3", "x5"):
+        p = int(shape[1])
+        return lo + (1 - lo) * t ** p
+    if shape == "log":
+        return lo * (1 / lo) ** t
+    if shape == "cie":
+        l0 = lum_to_cie(lo)
+        return cie_to_lum(l0 + (100 - l0) * t)
+    usage()
+
+def main(args):
+    if len(args) < 2:
+        usage()
+    levels = int(args[0])
+    shape = args[1]
+    chips = int(args[2]) if len(args) > 2 else 8
+    floor = float(args[3]) if len(args) > 3 else 1
+    phase = int(args[4]) if len(args) > 4 else 8
+    frac = int(args[5]) if len(args) > 5 else 0
+
+    if frac < 0 or frac > 8:
+        usage()
+    one = 1 << frac             # one PWM step
+    full = 255 * one
+    if levels < 2 or levels > 254 or floor * one < 1 or floor > 254:
+        usage()
+
+    # The values have to go up by at least one each step,
+    # or the table has levels you can't tell apart.
+    lo = floor / 255.0
+    pwm = []
+    for i in range(levels):
+        v = int(round(full * curve(shape, i, levels, lo)))
+        if pwm and v <= pwm[-1]:
+            v = pwm[-1] + 1
+        pwm.append(v)
+    if pwm[-1] > full:
+        sys.stderr.write("ramp_calc.py: too many levels for a floor of %g\n" % floor)
+        sys.exit(1)
+    pwm[-1] = full
+
+    nphase = len([v for v in pwm if v < phase * one])
+    for v in pwm[nphase:]:
+        if v < phase * one:
+            sys.stderr.write("ramp_calc.py: phase levels must come first\n")
+            sys.exit(1)
+
+    print("/* Generated by: ramp_calc.py %s" % " ".join(args))
+    print(" * Don't edit, change RAMP_ARGS in the Makefile instead.")
+    print(" *")
+    print(" * level      PWM  mode     duty       mA")
+    for i, v in enumerate(pwm):
+        # phase correct is on for OCR0B/255, fast PWM for (OCR0B+1)/256
+        p = v / float(one)
+        if i < nphase:
+            mode, duty = "phase", p / 255.0
+        else:
+            mode, duty = "fast", (p + 1) / 256.0
+        print(" * %5d %8.3f  %-5s %7.3f%% %8.1f" %
+              (i + 1, p, mode, duty * 100, duty * chips * MA_PER_CHIP))
+    print(" */")
+    print("#define RAMP_SIZE %d" % levels)
+    print("#define RAMP_PWM %s" % ",".join(str(v) for v in pwm))
+    print("#define RAMP_PHASE_LEVELS %d" % nphase)
+    print("#define RAMP_FRAC_BITS %d" % frac)
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
+
+# THE END
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+#
+# stats_decode.py -- report on the usage statistics in an EEPROM dump
+#
+# usage: stats_decode.py dump [calibration]
+#
+#   dump         the EEPROM, read out with avrdude, for example
+#                  avrdude -p t13 -c usbasp -U eeprom:r:stats.hex:i
+#                Intel hex (:i), raw binary (:r), or the hex (:h)
+#                and decimal (:d) lists all work
+#   calibration  tk-calibration.h from the firmware directory, to turn
+#                the lowest voltage reading into volts with the same
+#                ADC_* table the firmware uses (without it, a straight
+#                line fit: ADC = 42 * V + 7)
+#
+# The layout is the one in tk-stats.h (simple and biscotti), along with
+# the OPT_* cells at the top of the EEPROM.  Change both together.
+#
+# Copyright (C) 2026 the contributors to this repository (see git log)
+
+import sys
+import re
+
+EEPSIZE = 64
+STAT_BASE = EEPSIZE // 2
+STAT_LEVELS = 8
+STAT_boots_ones = STAT_BASE
+STAT_boots = STAT_BASE + 1
+STAT_minutes = STAT_BASE + 3
+STAT_stepdowns = STAT_minutes + 2 * STAT_LEVELS
+STAT_shutdowns = STAT_stepdowns + 2
+STAT_minvolt = STAT_shutdowns + 2
+
+OPT_modegroup = EEPSIZE - 1
+OPT_memory = EEPSIZE - 2
+OPT_mode_override = EEPSIZE - 3
+OPT_delay_cal = EEPSIZE - 5     # simple, with USE_DELAY_CAL
+OPT_osccal = EEPSIZE - 6        # biscotti, after OSCCAL_MODE
+
+# Delay loop passes in 4 ms at exactly 4.8 MHz
+DELAY_LOOPS = 4800000 // 1000
+
+def usage():
+    sys.stderr.write("usage: stats_decode.py dump [calibration]\n")
+    sys.exit(1)
+
+def read_ihex(text):
+    mem = {}
+    base = 0
+    for line in text.splitlines():
+        line = line.strip()
+        if not line.startswith(":"):
+            continue
+        rec = bytes.fromhex(line[1:])
+        if sum(rec) & 0xff:
+            sys.stderr.write("stats_decode.py: bad checksum: %s\n" % line)
+            sys.exit(1)
+        n, addr, kind = rec[0], (rec[1] << 8) | rec[2], rec[3]
+        if kind == 0:
+            for i in range(n):
+                mem[base + addr + i] = rec[4 + i]
+        elif kind == 2:
+            base = ((rec[4] << 8) | rec[5]) << 4
+        elif kind == 4:
+            base = ((rec[4] << 8) | rec[5]) << 16
+    return [mem.get(i, 0xff) for i in range(EEPSIZE)]
+
+def read_dump(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if len(data) == EEPSIZE and not data.lstrip().startswith(b":"):
+        return list(data)
+    text = data.decode("ascii", "replace")
+    if text.lstrip().startswith(":"):
+        return read_ihex(text)
+    words = [w for w in re.split(r"[\s,]+", text) if w]
+    try:
+        mem = [int(w, 0) for w in words]
+    except ValueError:
+        mem = []
+    if len(mem) != EEPSIZE:
+        sys.stderr.write("stats_decode.py: %s is not a %d byte EEPROM dump\n"
+                         % (path, EEPSIZE))
+        sys.exit(1)
+    return mem
+
+# ADC value to volts, from the ADC_xy table, or the line fit
+def adc_to_volts(adc, cal):
+    if not cal:
+        return (adc - 7) / 42.0
+    pts = sorted(cal)
+    if adc <= pts[0][0]:
+        lo, hi = pts[0], pts[1]
+    elif adc >= pts[-1][0]:
+        lo, hi = pts[-2], pts[-1]
+    else:
+        for lo, hi in zip(pts, pts[1:]):
+            if lo[0] <= adc <= hi[0]:
+                break
+    return lo[1] + (adc - lo[0]) * (hi[1] - lo[1]) / float(hi[0] - lo[0])
+
+def read_cal(path):
+    cal = []
+    with open(path) as f:
+        for line in f:
+            m = re.match(r"\s*#define\s+ADC_(\d)(\d)\s+(\d+)", line)
+            if m:
+                volts = int(m.group(1)) + int(m.group(2)) / 10.0
+                cal.append((int(m.group(3)), volts))
+    if len(cal) < 2:
+        sys.stderr.write("stats_decode.py: no ADC_* values in %s\n" % path)
+        sys.exit(1)
+    return cal
+
+# The counters are stored inverted, so erased reads as zero, and the
+# low byte is flipped while the high byte is even (stat_fold())
+def counter(mem, addr):
+    v = mem[addr] | (mem[addr + 1] << 8)
+    if not v & 0x100:
+        v ^= 0xff
+    return ~v & 0xffff
+
+def main(args):
+    if len(args) < 1 or len(args) > 2:
+        usage()
+    mem = read_dump(args[0])
+    cal = read_cal(args[1]) if len(args) > 1 else None
+
+    ones = bin(~mem[STAT_boots_ones] & 0xff).count("1")
+    boots = counter(mem, STAT_boots) * 8 + ones
+
+    print("mode group %d, memory %s, mode override %d" %
+          (mem[OPT_modegroup], "on" if mem[OPT_memory] else "off",
+           mem[OPT_mode_override]))
+    print("boots (clicks)   %d" % boots)
+    loops = mem[OPT_delay_cal] | (mem[OPT_delay_cal + 1] << 8)
+    if loops == 0xffff:
+        print("delay loop       not measured")
+    else:
+        print("delay loop       %d per 4 ms, clock %.2f MHz%s" %
+              (loops, 4.8 * loops / DELAY_LOOPS,
+               "" if DELAY_LOOPS * 3 // 4 <= loops <= DELAY_LOOPS * 5 // 4
+               else " (way off, goes by BOGOMIPS)"))
+    if mem[OPT_osccal] != 0xff:
+        print("oscillator trim  OSCCAL 0x%02x" % mem[OPT_osccal])
+
+    total = 0
+    print("time on, solid modes:")
+    for i in range(STAT_LEVELS):
+        minutes = counter(mem, STAT_minutes + 2 * i)
+        total += minutes
+        name = "level %d%s" % (i + 1, " and up" if i == STAT_LEVELS - 1 else "")
+        print("  %-14s %5d:%02d" % (name, minutes // 60, minutes % 60))
+    print("  %-14s %5d:%02d" % ("total", total // 60, total % 60))
+
+    print("LVP step downs   %d" % counter(mem, STAT_stepdowns))
+    print("LVP shutdowns    %d" % counter(mem, STAT_shutdowns))
+    minv = mem[STAT_minvolt]
+    if minv == 0xff:
+        print("lowest voltage   none seen")
+    else:
+        print("lowest voltage   %.2f V (ADC %d)" % (adc_to_volts(minv, cal), minv))
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
+
+# THE END
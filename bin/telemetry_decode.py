@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+#
+# telemetry_decode.py -- decode the serial telemetry from a debug build
+# of biscuit ("make TELEMETRY=1", see biscuit/tk-telemetry.h)
+#
+# usage: telemetry_decode.py [-r rate] [-c column] capture [calibration]
+#
+#   capture      a CSV file with the level of the telemetry pin (STAR4)
+#                  time,level      one line per change, time in seconds,
+#                                  a logic analyser export of transitions
+#                  with -r rate    one line per sample at that rate (Hz),
+#                                  like "sigrok-cli -O csv" writes
+#                lines that aren't numbers (headers) are skipped
+#   -c column    which column has the level, counting from 0
+#                (default 1, or 0 with -r)
+#   calibration  tk-calibration.h, to turn the ADC readings into volts
+#                (see stats_decode.py)
+#
+# The bit rate follows the PWM mode (one bit per timer 0 overflow),
+# so it is measured on the 0x55 sync byte of each frame.
+#
+# Copyright (C) 2026 the contributors to this repository (see git log)
+
+import sys
+import bisect
+
+from stats_decode import adc_to_volts, read_cal
+
+# The frame, from tk-telemetry.h
+TELEM_SYNC = 0x55
+TELEM_LEN = 7
+
+# Seconds between frames that must be a power cycle, even a
+# short press starts the tick over at 1 though
+RESTART = 2.0
+
+def usage():
+    sys.stderr.write("usage: telemetry_decode.py [-r rate] [-c column] capture [calibration]\n")
+    sys.exit(1)
+
+# Returns the times and levels of the changes on the line
+def read_capture(path, rate, column):
+    times = []
+    levels = []
+    n = 0
+    with open(path) as f:
+        for line in f:
+            cols = line.replace(",", " ").split()
+            try:
+                if rate:
+                    t = n / rate
+                    level = int(float(cols[column]))
+                else:
+                    t = float(cols[0])
+                    level = int(float(cols[column]))
+            except (ValueError, IndexError):
+                continue
+            n += 1
+            level = 1 if level else 0
+            if not levels or levels[-1] != level:
+                times.append(t)
+                levels.append(level)
+    return times, levels
+
+class Line:
+    def __init__(self, times, levels):
+        self.times = times
+        self.levels = levels
+
+    def at(self, t):
+        i = bisect.bisect_right(self.times, t) - 1
+        return self.levels[i] if i >= 0 else 1
+
+# A sync byte is a start bit then 10101010 and the stop bit:
+# 10 edges, each one bit after the last.  Returns the bit time or None.
+def sync_at(line, i):
+    times = line.times
+    if i + 9 >= len(times) or line.levels[i] != 0:
+        return None
+    bit = (times[i + 9] - times[i]) / 9.0
+    for j in range(i, i + 9):
+        if abs(times[j + 1] - times[j] - bit) > bit / 4:
+            return None
+    return bit
+
+def read_byte(line, t, bit):
+    if line.at(t + 0.5 * bit) != 0 or line.at(t + 9.5 * bit) != 1:
+        return None
+    v = 0
+    for j in range(8):
+        v |= line.at(t + (j + 1.5) * bit) << j
+    return v
+
+def frames(line):
+    i = 0
+    while i < len(line.times):
+        bit = sync_at(line, i)
+        if bit is None:
+            i += 1
+            continue
+        t0 = line.times[i]
+        data = [read_byte(line, t0 + 10 * k * bit, bit) for k in range(TELEM_LEN)]
+        ok = None not in data and data[0] == TELEM_SYNC and sum(data[1:]) & 0xff == 0
+        yield t0, bit, data, ok
+        # Ten even edges aren't likely to be anything but a sync byte,
+        # so even a bad frame takes up the whole frame time
+        i = bisect.bisect_left(line.times, t0 + 10 * TELEM_LEN * bit, i + 1)
+
+def main(args):
+    rate = None
+    column = None
+    while args and args[0].startswith("-"):
+        if len(args) < 2:
+            usage()
+        if args[0] == "-r":
+            rate = float(args[1])
+        elif args[0] == "-c":
+            column = int(args[1])
+        else:
+            usage()
+        args = args[2:]
+    if len(args) < 1 or len(args) > 2:
+        usage()
+    if column is None:
+        column = 0 if rate else 1
+    times, levels = read_capture(args[0], rate, column)
+    cal = read_cal(args[1]) if len(args) > 1 else None
+
+    good = bad = dropped = 0
+    last = None
+    gaps = []
+    print("#    time_s   baud tick     adc  volts lowbatt out sel")
+    for t, bit, data, ok in frames(Line(times, levels)):
+        if not ok:
+            bad += 1
+            print("%10.4f %6.0f bad frame: %s" % (t, 1 / bit,
+                  " ".join("--" if b is None else "%02x" % b for b in data)))
+            continue
+        good += 1
+        tick = data[1]
+        adc = (data[2] | (data[3] << 8)) / 256.0
+        print("%10.4f %6.0f %4d %7.2f %6.3f %7d %3d %3d" % (t, 1 / bit, tick, adc,
+              adc_to_volts(adc, cal), data[4], data[5] & 0xf, data[5] >> 4))
+        # The light went off and on again, the tick starts over
+        if last and (t - last[0] > RESTART or tick == 1):
+            last = None
+        if last:
+            skipped = (tick - last[1] - 1) & 0xff
+            dropped += skipped
+            gaps.append((t - last[0]) / (skipped + 1))
+        last = (t, tick)
+
+    print("# %d frames, %d bad, %d dropped" % (good, bad, dropped))
+    if gaps:
+        print("# tick period %.1f ms, from %.1f to %.1f" % (
+              1000 * sum(gaps) / len(gaps), 1000 * min(gaps), 1000 * max(gaps)))
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
+
+# THE END
@@ -72,8 +72,19 @@
  * (note that we do subtract 1 from the table value)
  */
 
+// Building with RAMP_ARGS set in the Makefile replaces these
+// with a table made by ../bin/ramp_calc.py
+#ifdef USE_RAMP_H
+#include "ramp.h"
+#if RAMP_FRAC_BITS
+#error "no PWM dithering here, leave the fraction bits out of RAMP_ARGS"
+#endif
+#define RAMP_FET   RAMP_PWM
+#else
 #define RAMP_SIZE  7
 #define RAMP_FET   1,7,32,63,107,127,255
+#define RAMP_PHASE_LEVELS 2
+#endif
 // some other old scheme
 //#define RAMP_FET   6,12,34,108,255
 
@@ -102,6 +113,13 @@
 
 #define GROUP_SELECT_MODE 253
 
+// Config option 3: on the next power on, trim the oscillator
+// against the watchdog and keep the trim in EEPROM (tk-osccal.h)
+// Opt-in, off by default: doesn't fit in 1K along with the rest, about
+// 200 bytes, so the light as shipped runs on the factory trim.  host/
+// checks it (biscotti-opt-host)
+//#define OSCCAL_MODE 252
+
 // Uncomment to enable tactical strobe mode
 // TJT comments this out to save space.
 // #define ANY_STROBE  // required for strobe or police_strobe
@@ -118,6 +136,16 @@
 
 #define SOS 246
 
+// A beacon that powers the chip down between flashes, so it can run
+// for days.  The watchdog wakes it every 2 seconds for one flash.
+// It comes after BATTCHECK in mode group 4 when it is on.
+// Opt-in, off by default: doesn't fit in 1K along with the rest, about
+// 60 bytes, so the light as shipped has no beacon.  host/ checks it
+// (biscotti-opt-host)
+//#define BEACON 245
+#define BEACON_ON   (40/4)  // time at full, in 4 ms units
+#define BEACON_WDP  ((1 << WDP2) | (1 << WDP1) | (1 << WDP0))  // 2 s
+
 // Calibrate voltage and OTC in this file:
 #include "tk-calibration.h"
 
@@ -133,20 +161,65 @@
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
 #include <avr/sleep.h>
+#include <avr/wdt.h>
 //#include <avr/power.h>
 #include <string.h>
 
 #define OWN_DELAY           // Don't use stock delay functions.
 #define USE_DELAY_4MS
 #define USE_DELAY_S         // Also use _delay_s(), not just _delay_ms()
+// Time delays off timer 0 and sleep through them (see tk-delay.h)
+// Opt-in, off by default: doesn't fit in 1K along with the rest, about
+// 40 bytes, so the light as shipped busy waits.  host/ checks it
+// (biscotti-opt-host)
+//#define USE_TIMER_DELAY
 #include "tk-delay.h"
 
+// Let EEPROM writes finish in the background (uses 18 bytes of RAM)
+// Doesn't fit in 1K along with the strobes, about 60 bytes
+//#define USE_EEPROM_QUEUE
+#include "tk-eeprom.h"
+
+// Keep usage statistics in EEPROM (see tk-stats.h)
+// Opt-in, off by default: doesn't fit in 1K along with the strobes,
+// so the light as shipped keeps none.  host/ checks it (biscotti-opt-host)
+//#define USE_STATS
+#ifdef USE_STATS
+#include "tk-stats.h"
+// Passes through the main loop (_delay_4ms(125)) in a minute.  Without
+// USE_TIMER_DELAY a "4 ms" is BOGOMIPS*4 delay loops of 4 clocks, 3.2 ms
+// at 4.8 MHz, so a minute is 152 passes, not 120.
+#ifdef USE_TIMER_DELAY
+#define STAT_TICKS  120
+#else
+#define STAT_TICKS  ((60UL * F_CPU + 125UL * BOGOMIPS * 8) / (125UL * BOGOMIPS * 16))
+#endif
+#endif
+
+// Change PWM mode and level only between PWM periods
+// Doesn't fit in 1K along with the strobes
+//#define USE_PWM_SYNC
+#include "tk-pwm.h"
+
 #include "tk-voltage.h"
 
+// Keep the analog comparator and the unused stars off, and at LVP
+// shutdown power down with the ADC, watchdog and BOD off (tk-power.h)
+// Doesn't fit in 1K along with the rest, about 25 bytes
+//#define USE_POWER
+#ifdef USE_POWER
+#define POWER_UNUSED ((1 << STAR2_PIN) | (1 << STAR3_PIN) | (1 << STAR4_PIN))
+#include "tk-power.h"
+#endif
+
 #ifdef RANDOM_STROBE
 #include "tk-random.h"
 #endif
 
+#ifdef OSCCAL_MODE
+#include "tk-osccal.h"
+#endif
+
 /*
  * global variables
  */
@@ -180,7 +253,11 @@ PROGMEM const uint8_t modegroups[] = {
      1,  2,  3,  5,  7,  POLICE_STROBE, BIKING_STROBE, BATTCHECK,
      1,  2,  3,  5,  7,  0,  0,  0,
      7,  5,  3,  2,  1,  0,  0,  0,
+#ifdef BEACON
+     2,  4,  7,  POLICE_STROBE, BIKING_STROBE, BATTCHECK, BEACON, SOS,
+#else
      2,  4,  7,  POLICE_STROBE, BIKING_STROBE, BATTCHECK, SOS,  0,
+#endif
      2,  4,  7,  0,  0,  0,  0,  0,
      7,  4,  2,  0,  0,  0,  0,  0,
      1,  2,  3,  6,  POLICE_STROBE, BIKING_STROBE, BATTCHECK, SOS,
@@ -191,8 +268,6 @@ PROGMEM const uint8_t modegroups[] = {
      7,  0,
 };
 
-uint8_t modes[8];  // make sure this is long enough...
-
 // Modes (gets set when the light starts up based on saved config values)
 //PROGMEM const uint8_t ramp_7135[] = { RAMP_7135 };
 PROGMEM const uint8_t ramp_FET[]  = { RAMP_FET };
@@ -201,23 +276,43 @@ PROGMEM const uint8_t ramp_FET[]  = { RAMP_FET };
  * We don't just save it, but we fool around using the
  * entire first half of the EEPROM to perform wear
  * leveling.
+ *
+ * The log is a ring of 32 cells, and the position in the ring
+ * serves as the sequence number.  Half the ring (the 16 cells
+ * ending at eepos) holds saved values, the other half is erased.
+ * Each save writes the next cell, then erases the cell half way
+ * around.  The next cell was erased 16 saves ago, so the write is
+ * a write-only one (EEP_WRITE), which only clears bits: each cell
+ * sees one erase and one write-only per trip round the ring, where
+ * the old scheme gave it two full erase and write cycles.
+ *
+ * A cell holds mode_idx in its low four bits and their complement
+ * in the high four (EEP_MODE()), which is enough for 0 .. 7 and the
+ * override modes, 248 and up.  A write that was cut short has only
+ * cleared some of the bits it meant to, and no such partial value
+ * passes EEP_VALID(), nor does an erased 0xff.
+ *
+ * Because the written cells are always one contiguous run, boot
+ * can find the newest with a binary search instead of a scan.
+ * Writing first and erasing second means losing power half way
+ * through leaves a run of 17, which at worst reads back as the
+ * save before.  restore_state() erases the extra cell, or the
+ * run would move on and leave it behind in the erased half.
+ * It also erases a newest cell that isn't valid, and goes back
+ * to the one before.
  */
 #define WEAR_LVL_LEN (EEPSIZE/2)  // must be a power of 2
+#define WEAR_LVL_HALF (WEAR_LVL_LEN/2)
+
+#define EEP_MODE(m)     (((m) & 0x0f) | (~(m) << 4))
+#define EEP_VALID(v)    (((((v) >> 4) ^ (v)) & 0x0f) == 0x0f)
 
 void
 save_mode() {  // save the current mode index (with wear leveling)
-    uint8_t oldpos=eepos;
-
     eepos = (eepos+1) & (WEAR_LVL_LEN-1);  // wear leveling, use next cell
-    /*
-    eepos ++;
-    if (eepos > (EEPSIZE-4)) {
-        eepos = 0;
-    }
-    */
 
-    eeprom_write_byte((uint8_t *)(eepos), mode_idx);  // save current state
-    eeprom_write_byte((uint8_t *)(oldpos), 0xff);     // erase old state
+    eep_write(eepos | EEP_WRITE, EEP_MODE(mode_idx));  // save current state
+    eep_write(((eepos+WEAR_LVL_HALF) & (WEAR_LVL_LEN-1)) | EEP_ERASE, 0xff);
 }
 
 //#define OPT_firstboot (EEPSIZE-1)
@@ -226,6 +321,11 @@ save_mode() {  // save the current mode index (with wear leveling)
 //#define OPT_offtim3 (EEPSIZE-4) -- not used
 //#define OPT_maxtemp (EEPSIZE-5) -- not used
 #define OPT_mode_override (EEPSIZE-3)
+#define OPT_osccal (EEPSIZE-6)  // written only by OSCCAL_MODE
+
+#if defined(USE_STATS) && STAT_END > OPT_osccal
+#error "tk-stats.h runs into the OPT_* cells"
+#endif
 //#define OPT_moon (EEPSIZE-7)
 //#define OPT_revmodes (EEPSIZE-8)
 //#define OPT_muggle (EEPSIZE-9) -- not used
@@ -235,12 +335,12 @@ save_state() {  // central method for writing complete state
 	/* tjt - This saves the value of mode_idx */
     save_mode();
 
-    eeprom_write_byte((uint8_t *)OPT_modegroup, modegroup);
-    eeprom_write_byte((uint8_t *)OPT_memory, memory);
-    eeprom_write_byte((uint8_t *)OPT_mode_override, mode_override);
-    //eeprom_write_byte((uint8_t *)OPT_moon, enable_moon);
-    //eeprom_write_byte((uint8_t *)OPT_revmodes, reverse_modes);
-    //eeprom_write_byte((uint8_t *)OPT_muggle, muggle_mode);
+    eep_write(OPT_modegroup, modegroup);
+    eep_write(OPT_memory, memory);
+    eep_write(OPT_mode_override, mode_override);
+    //eep_write(OPT_moon, enable_moon);
+    //eep_write(OPT_revmodes, reverse_modes);
+    //eep_write(OPT_muggle, muggle_mode);
 }
 
 /* tjt - this gets called when we decide this is the first
@@ -258,10 +358,21 @@ static inline void reset_state() {
 }
 
 /* tjt - Called once right after startup.
- * It scans the first half of EEPROM looking
- * for a byte that is not 0xff.  If it finds
- * such a byte, that is the selected mode index
- * If not, it calls reset_state()
+ * It looks in the first half of EEPROM for the newest
+ * saved value of mode_idx (see save_mode() above).
+ * If it doesn't find one, it calls reset_state()
+ *
+ * If cell 0 holds a value, the run of saved values starts in
+ * the first half of the ring (or wraps into it) and ends there.
+ * Otherwise it lies entirely in the second half, starting no
+ * later than cell 16.  Either way the search covers 16 cells
+ * starting at 0 or 16, so it takes 4 reads, 6 with cell 0 and
+ * the result.  If the cell it lands on is erased too, nothing
+ * was ever saved.  One more read checks that the cell half way
+ * round is erased, as it is unless a save was cut short.
+ * A newest cell that was cut short itself is erased, and the
+ * one before it read instead.  On a first boot, whatever else is
+ * in the ring (another firmware's cells) is erased too.
  *
  * Note that mode_idx is a value 0 .. 7 that picks the
  * mode within the group.
@@ -269,25 +380,47 @@ static inline void reset_state() {
  */
 void
 restore_state() {
-    uint8_t eep;
-
-    uint8_t first = 1;
+    uint8_t step, half, v;
 
     // find the mode index data
-    for(eepos=0; eepos<WEAR_LVL_LEN; eepos++) {
-        eep = eeprom_read_byte((const uint8_t *)eepos);
-        if (eep != 0xff) {
-            mode_idx = eep;
-            first = 0;
-            break;
-        }
+    eepos = 0;
+    if (eeprom_read_byte((const uint8_t *)0) == 0xff)
+        eepos = WEAR_LVL_HALF;
+    for (step = WEAR_LVL_HALF/2; step; step >>= 1) {
+        if (eeprom_read_byte((const uint8_t *)(eepos+step)) != 0xff)
+            eepos += step;
+    }
+
+    // a cut in the middle of the write in save_mode()
+    // (or cells from some other firmware, all of them go)
+    while ((v = eeprom_read_byte((const uint8_t *)eepos)) != 0xff &&
+           ! EEP_VALID(v)) {
+        eep_write(eepos | EEP_ERASE, 0xff);
+        eep_flush();
+        eepos = (eepos-1) & (WEAR_LVL_LEN-1);
     }
 
     // if no mode_idx was found, assume this is the first boot
-    if (first) {
+    if (v == 0xff) {
+        // and make sure the ring is erased, for the write-only saves
+        for (v = 0; v < WEAR_LVL_LEN; v++) {
+            if (eeprom_read_byte((const uint8_t *)v) != 0xff) {
+                eep_write(v | EEP_ERASE, 0xff);
+                eep_flush();
+            }
+        }
+        eepos = WEAR_LVL_LEN-1;     // so the first save goes in cell 0
         reset_state();
         return;
     }
+    mode_idx = v & 0x0f;
+    if (mode_idx & 0x08)            // the override modes
+        mode_idx |= 0xf0;
+
+    // a cut between the write and the erase in save_mode()
+    half = (eepos+WEAR_LVL_HALF) & (WEAR_LVL_LEN-1);
+    if (eeprom_read_byte((const uint8_t *)half) != 0xff)
+        eep_write(half | EEP_ERASE, 0xff);
 
     // load other config values
     modegroup = eeprom_read_byte((uint8_t *)OPT_modegroup);
@@ -297,10 +430,6 @@ restore_state() {
     //reverse_modes = eeprom_read_byte((uint8_t *)OPT_revmodes);
     //muggle_mode   = eeprom_read_byte((uint8_t *)OPT_muggle);
 
-    // unnecessary, save_state handles wrap-around
-    // (and we don't really care about it skipping cell 0 once in a while)
-    //else eepos=0;
-
     if (modegroup >= NUM_MODEGROUPS)
 		reset_state();
 }
@@ -313,13 +442,24 @@ next_mode() {
     }
 }
 
+// The value of mode "idx" in the current group
+static inline uint8_t
+get_mode ( uint8_t idx ) {
+    return pgm_read_byte(modegroups + (modegroup<<3) + idx);
+}
+
 /* tjt - this is called once, early in main()
  * A more apt name would be "setup_modes()" perhaps
- * In particular, based on "modegrup" this copies the 8 values
- * for that selection into the "modes" array.
+ * In particular, based on "modegrup" it counts the
+ * modes in that selection.
  *
  * The value of "modegroup" is set in restore_state()
  * which gets called just before this routine gets called.
+ *
+ * The modes themselves used to get copied into a "modes[8]"
+ * array, but that is 8 of our 64 bytes of RAM holding
+ * something that is already in flash.  Now get_mode()
+ * reads them from the table as needed.
  */
 void
 count_modes() {
@@ -329,8 +469,6 @@ count_modes() {
      * (this matters because we have more than one set of modes to choose
      *  from, so we need to count at runtime)
      */
-    uint8_t *dest = modes;
-    const uint8_t *src = modegroups + (modegroup<<3);
     uint8_t count;
 
     // Figure out how many modes are in this group
@@ -338,30 +476,31 @@ count_modes() {
     // No, how about actually counting the modes instead?
     // (in case anyone changes the mode groups above so they don't form a triangle)
 
-    for(count=0; (count<8) && pgm_read_byte(src); count++, src++ ) {
-		*dest++ = pgm_read_byte(src);
-    }
+    for(count=0; (count<8) && get_mode(count); count++)
+        ;
 
     solid_modes = count;
 
 }	/* End of count_modes() */
 
 static inline void
-set_output ( uint8_t pwm1 ) {
+set_output ( uint8_t mode, uint8_t pwm1 ) {
     /* This is no longer needed since we always use PHASE mode.
     // Need PHASE to properly turn off the light
     if ((pwm1==0) && (pwm2==0)) {
         TCCR0A = PHASE;
     }
     */
-    PWM_LVL = pwm1;
+    // Both at once, at the end of a PWM period (tk-pwm.h)
+    set_pwm(mode, pwm1);
 }
 
 void
 set_level(uint8_t level) {
-    TCCR0A = PHASE;
+    uint8_t mode = PHASE;
+
     if (level == 0) {
-        set_output(0);
+        set_output(mode, 0);
     } else {
         //level -= 1;
         /* apparently not needed on the newer drivers
@@ -371,12 +510,12 @@ set_level(uint8_t level) {
             TCCR0B = 0x02;
         }
         */
-        if (level > 2) {
+        if (level > RAMP_PHASE_LEVELS) {
             // divide PWM speed by 2 for moon and low,
             // because the nanjg 105d chips are SLOW
-            TCCR0A = FAST;
+            mode = FAST;
         }
-        set_output ( pgm_read_byte(ramp_FET + level - 1) );
+        set_output ( mode, pgm_read_byte(ramp_FET + level - 1) );
     }
 }
 
@@ -395,21 +534,68 @@ void blink(uint8_t val, uint8_t speed)
     }
 }
 
-#ifdef ANY_STROBE
-static inline void strobe(uint8_t ontime, uint8_t offtime) {
-    uint8_t i;
-    for(i=0;i<8;i++) {
-        set_level(RAMP_SIZE);
-        _delay_4ms(ontime);
-        set_level(0);
-        _delay_4ms(offtime);
+/*
+ * Strobes and beacons are patterns in flash, played by play().
+ * Each step is a level and a time, in 4 ms units (_delay_4ms(), with
+ * USE_TIMER_DELAY timed off timer 0, sleeping in between).  A time
+ * of 0 ends the pattern.  One pass through the main loop plays it
+ * once.  Repeats are written out in the table (TIMES3() and so on),
+ * which costs less flash than a repeat count in every step would.
+ */
+#define TWICE(...)      __VA_ARGS__, __VA_ARGS__
+#define TIMES3(...)     __VA_ARGS__, TWICE(__VA_ARGS__)
+#define TIMES8(...)     TWICE(TWICE(TWICE(__VA_ARGS__)))
+
+static inline void play(const uint8_t *p)
+{
+    uint8_t t;
+
+    while ((t = pgm_read_byte(p + 1))) {
+        set_level(pgm_read_byte(p));
+        _delay_4ms(t);
+        p += 2;
     }
 }
+
+#ifdef STROBE
+// 10Hz tactical strobe
+const uint8_t strobe_pattern[] PROGMEM = {
+    TIMES8(RAMP_SIZE, 33/4, 0, 67/4),
+    0, 0
+};
+#endif
+
+// TJT wraps this in ANY_STROBE
+#ifdef ANY_STROBE
+#ifdef POLICE_STROBE
+// police-like strobe
+const uint8_t police_pattern[] PROGMEM = {
+    TIMES8(RAMP_SIZE, 20/4, 0, 40/4),
+    TIMES8(RAMP_SIZE, 40/4, 0, 80/4),
+    0, 0
+};
+#endif
+#endif
+
+#ifdef BIKING_STROBE
+// 2-level stutter beacon for biking and such
+const uint8_t biking_pattern[] PROGMEM = {
+#ifdef FULL_BIKING_STROBE
+    // normal version
+    TWICE(TWICE(RAMP_SIZE, 3, 4, 15)),
+    4, 250,
+#else
+    // small/minimal version
+    RAMP_SIZE, 8, 3, 250,
+#endif
+    0, 0
+};
 #endif
 
 #ifdef SOS
 #define SOS_SPEED (200/4)
 
+// No table for this one, blink() does it in less flash
 static inline
 void SOS_mode() {
     blink(3, SOS_SPEED);
@@ -421,6 +607,52 @@ void SOS_mode() {
 }
 #endif
 
+#ifdef BEACON
+EMPTY_INTERRUPT(WDT_vect);
+
+/* Power down until the watchdog interrupt, then one flash at level
+ * (full, until LVP steps it down), and back off before returning.
+ * The ADC is off while we sleep (left on, it would keep drawing
+ * current), and takes the reading the main loop looks at for LVP
+ * during the flash.  Timer 0 stops too, so the PWM output is taken
+ * off the pin first: it would stay wherever the timer left it, and
+ * OCR0B = 0 may not have latched yet (tk-pwm.h).  set_level() puts
+ * it back.  So the first flash comes 2 seconds after we get to this
+ * mode.
+ */
+void beacon(uint8_t level)
+{
+    set_level(0);
+    pwm_wait();
+    TCCR0A = 0;
+    ADCSRA &= ~(1 << ADEN);
+    cli();
+    wdt_reset();
+    WDTCR |= (1 << WDCE) | (1 << WDE);  // Start timed sequence
+    WDTCR = (1 << WDTIE) | BEACON_WDP;  // Interrupt, no reset
+    sei();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_mode();
+
+    ADCSRA |= (1 << ADEN) | (1 << ADSC);
+    set_level(level > RAMP_SIZE ? RAMP_SIZE : level);
+    _delay_4ms(BEACON_ON);
+    set_level(0);   // dark for the rest of the main loop, too
+}
+#endif
+
+#ifdef RANDOM_STROBE
+static inline void strobe(uint8_t ontime, uint8_t offtime) {
+    uint8_t i;
+    for(i=0;i<8;i++) {
+        set_level(RAMP_SIZE);
+        _delay_4ms(ontime);
+        set_level(0);
+        _delay_4ms(offtime);
+    }
+}
+#endif
+
 void
 toggle(uint8_t *var, uint8_t num) {
     // Used for config mode
@@ -447,12 +679,54 @@ toggle(uint8_t *var, uint8_t num) {
     _delay_s();
 }
 
+/* LVP at the lowest level, turn off for good.
+ * With USE_POWER, first give the cell a second with the LED off,
+ * and if it comes back up to ADC_RECOVER, return and go on.
+ */
+static inline void lvp_off(void)
+{
+    set_level(0);
+    pwm_wait();
+#ifdef USE_POWER
+    _delay_s();
+    if (get_voltage() >= ADC_RECOVER)
+        return;
+#endif
+#ifdef USE_STATS
+    stat_add(STAT_shutdowns);
+#endif
+    // A write still in the queue would be lost
+    eep_flush();
+#ifdef USE_POWER
+    power_down();
+#else
+    // Power down as many components as possible
+    // With interrupts off, the watchdog (BEACON) can't wake us.
+    cli();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_mode();
+#endif
+}
+
 int
 main(void)
 {
+#ifdef OSCCAL_MODE
+    // Our own oscillator trim, if we have one.  Get there one step
+    // at a time, like osccal_tune() does.
+    uint8_t cal = eeprom_read_byte((uint8_t *)OPT_osccal);
+    if (cal <= 0x7f)
+        while (OSCCAL != cal)
+            OSCCAL += cal > OSCCAL ? 1 : -1;
+#endif
+
     // Assign PWM pin to output
     DDRB |= (1 << PWM_PIN);     // enable main channel
 
+#ifdef USE_POWER
+    power_init();
+#endif
+
     // Set timer to do PWM for correct output pin and set prescaler timing
     //TCCR0A = 0x23; // phase corrected PWM is 0x21 for PB1, fast-PWM is 0x23
     //TCCR0B = 0x01; // pre-scaler for timer (1 => 1, 2 => 8, 3 => 64...)
@@ -460,6 +734,10 @@ main(void)
     // Set timer to do PWM for correct output pin and set prescaler timing
     TCCR0B = 0x01; // pre-scaler for timer (1 => 1, 2 => 8, 3 => 64...)
 
+#if defined(USE_EEPROM_QUEUE) || defined(USE_PWM_SYNC) || defined(USE_TIMER_DELAY) || defined(BEACON)
+    sei();      // the write queue, PWM changes and delays run from interrupts
+#endif
+
     // Read config values and saved state
     restore_state();
 
@@ -493,6 +771,30 @@ main(void)
     }
 
     long_press = 0;
+
+    uint8_t output;
+    uint8_t actual_level;
+
+    output = get_mode(mode_idx);
+    actual_level = output;
+
+    // handle mode overrides, like mode group selection and temperature calibration
+    if (mode_override) {
+        // do nothing; mode is already set
+        //mode_idx = mode_override;
+        fast_presses = 0;
+        output = mode_idx;
+    }
+
+    // Light up a solid mode right away, before saving the mode and
+    // starting the ADC.  The main loop sets it again, which is harmless.
+    // (not for config mode, which starts out dark)
+    if (fast_presses <= 9 && output <= RAMP_SIZE)
+        set_mode(actual_level);
+
+#ifdef USE_STATS
+    stat_boot();
+#endif
     save_mode();
 
     // Turn features on or off as needed
@@ -503,9 +805,6 @@ main(void)
     ADC_off();
     #endif
 
-    uint8_t output;
-    uint8_t actual_level;
-
 #ifdef VOLTAGE_MON
     uint8_t lowbatt_cnt = 0;
     uint8_t i = 0;
@@ -513,18 +812,9 @@ main(void)
     // Make sure voltage reading is running for later
     ADCSRA |= (1 << ADSC);
 #endif
-
-    //output = pgm_read_byte(modes + mode_idx);
-    output = modes[mode_idx];
-    actual_level = output;
-
-    // handle mode overrides, like mode group selection and temperature calibration
-    if (mode_override) {
-        // do nothing; mode is already set
-        //mode_idx = mode_override;
-        fast_presses = 0;
-        output = mode_idx;
-    }
+#ifdef USE_STATS
+    uint8_t stat_ticks = 0;
+#endif
 
     while(1) {
         if (fast_presses > 9) {  // Config mode
@@ -545,17 +835,23 @@ main(void)
 
             toggle(&memory, 2);
 
+#ifdef OSCCAL_MODE
+            // Trim the oscillator?
+            mode_idx = OSCCAL_MODE;
+            toggle(&mode_override, 3);
+            mode_idx = 0;
+#endif
+
             //toggle(&firstboot, 8);
 
             //output = pgm_read_byte(modes + mode_idx);
-            output = modes[mode_idx];
+            output = get_mode(mode_idx);
             actual_level = output;
         }
 
 #ifdef STROBE
         else if (output == STROBE) {
-            // 10Hz tactical strobe
-            strobe(33/4,67/4);
+            play(strobe_pattern);
         }
 #endif // ifdef STROBE
 
@@ -563,13 +859,7 @@ main(void)
 #ifdef ANY_STROBE
 #ifdef POLICE_STROBE
         else if (output == POLICE_STROBE) {
-            // police-like strobe
-            //for(i=0;i<8;i++) {
-                strobe(20/4,40/4);
-            //}
-            //for(i=0;i<8;i++) {
-                strobe(40/4,80/4);
-            //}
+            play(police_pattern);
         }
 #endif // ifdef POLICE_STROBE
 #endif // ifdef ANY_STROBE
@@ -585,24 +875,7 @@ main(void)
 
 #ifdef BIKING_STROBE
         else if (output == BIKING_STROBE) {
-            // 2-level stutter beacon for biking and such
-#ifdef FULL_BIKING_STROBE
-            // normal version
-            for(i=0;i<4;i++) {
-                set_mode(RAMP_SIZE);
-                _delay_4ms(3);
-                set_mode(4);
-                _delay_4ms(15);
-            }
-            //_delay_ms(720);
-            _delay_s();
-#else
-            // small/minimal version
-            set_mode(RAMP_SIZE);
-            _delay_4ms(8);
-            set_mode(3);
-            _delay_s();
-#endif
+            play(biking_pattern);
         }
 #endif  // ifdef BIKING_STROBE
 
@@ -610,6 +883,10 @@ main(void)
         else if (output == SOS) { SOS_mode(); }
 #endif // ifdef SOS
 
+#ifdef BEACON
+        else if (output == BEACON) { beacon(actual_level); }
+#endif // ifdef BEACON
+
 #ifdef BATTCHECK
         else if (output == BATTCHECK) {
             // blink zero to five times to show voltage
@@ -635,12 +912,38 @@ main(void)
             _delay_s();
         }
 
+#ifdef OSCCAL_MODE
+        else if (output == OSCCAL_MODE) {
+            // exit this mode after one use
+            mode_idx = 0;
+            mode_override = 0;
+
+            // in the dark, the LED load would pull down Vcc
+            set_level(0);
+            pwm_wait();
+            osccal_tune();
+            eep_write(OPT_osccal, OSCCAL);
+            save_state();
+
+            // then on in the first mode, timed with the new clock
+            output = get_mode(mode_idx);
+            actual_level = output;
+        }
+#endif
+
         else {  // Regular non-hidden solid mode
             set_mode(actual_level);
 			// Temperature mon stuff used to be here.
             // just sleep.
             _delay_4ms(125);
 
+#ifdef USE_STATS
+            if (++stat_ticks >= STAT_TICKS) {
+                stat_ticks = 0;
+                stat_minute(actual_level);
+            }
+#endif
+
             // If we got this far, the user has stopped fast-pressing.
             // So, don't enter config mode.
             //fast_presses = 0;
@@ -652,6 +955,9 @@ main(void)
 #ifdef VOLTAGE_MON
         if (ADCSRA & (1 << ADIF)) {  // if a voltage reading is ready
             voltage = ADCH;  // get the waiting value
+#ifdef USE_STATS
+            stat_voltage(voltage);
+#endif
             // See if voltage is lower than what we were looking for
             if (voltage < ADC_LOW) {
                 lowbatt_cnt ++;
@@ -676,14 +982,20 @@ main(void)
                 } else { // Already at the lowest mode
                     //mode_idx = 0;  // unnecessary; we never leave this clause
                     //actual_level = 0;  // unnecessary; we never leave this clause
-                    // Turn off the light
-                    set_level(0);
-                    // Power down as many components as possible
-                    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-                    sleep_mode();
+                    // Turn off the light, unless the cell rebounds
+                    lvp_off();
                 }
+#ifdef USE_STATS
+                stat_add(STAT_stepdowns);
+#endif
+#ifdef BEACON
+                // The beacon stays a beacon, and flashes at actual_level
+                if (output != BEACON)
+#endif
+                {
                 set_mode(actual_level);
                 output = actual_level;
+                }
                 //save_mode();  // we didn't actually change the mode
                 lowbatt_cnt = 0;
                 // Wait before lowering the level again
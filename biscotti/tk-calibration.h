@@ -58,6 +58,23 @@
 #define ADC_0p     ADC_30  // the ADC value for 0% full (resting)
 #define ADC_LOW    ADC_30  // When do we start ramping down
 #define ADC_CRIT   ADC_27  // When do we shut the light off
+#define ADC_RECOVER ADC_33 // When do we ramp back up (must be above ADC_LOW)
+
+
+/********************** Output compensation ******************************/
+// Used by USE_COMPENSATION, see comp_gain() in tk-voltage.h.
+// Once the cell sags to within a few hundred mV of the LED forward
+// voltage, the 7135s can't hold their current any more and the light
+// dims.  These are the factors to scale the PWM duty by to make up
+// for it, in 2.6 fixed point (64 is 1.0), one per COMP_ADC_STEP ADC
+// counts (about 0.1 V) of loaded voltage, starting at COMP_ADC_TOP and
+// going down.  Above the top it's 1.0, below the bottom the last entry.
+// These are a starting point only: measure your light with a meter at
+// each voltage and fill in the current at full duty vs. the current
+// at 4 V.  Measure, don't guess.
+#define COMP_ADC_TOP    ADC_36
+#define COMP_ADC_STEP   4   // must be a power of 2
+#define COMP_GAINS      64, 66, 69, 73, 79, 87, 98, 112
 
 
 /********************** Offtime capacitor calibration ********************/
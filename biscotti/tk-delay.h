@@ -45,11 +45,47 @@ void _delay_zero() {
 }
 #endif
 #ifdef USE_DELAY_4MS
+#ifdef USE_TIMER_DELAY
+/*
+ * Time _delay_4ms() off timer 0 instead of counting instructions.
+ * Timer 0 is the PWM, always running at F_CPU.  With OCR0A halfway up,
+ * compare A matches once a fast PWM period (256 clocks) and twice a
+ * phase correct one (510), so a match is the same time in either mode,
+ * near enough.  We idle sleep in between, and the interrupt does
+ * nothing but wake us.  So strobes and blinks don't depend on BOGOMIPS
+ * or on what the code between two delays costs, and the CPU sleeps
+ * through them.  Interrupts must be enabled (sei).  Any other interrupt
+ * also wakes us, and makes that delay one match (53 us) shorter.
+ */
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#define DELAY_4MS_MATCHES   (F_CPU / 256 / 250)
+
+EMPTY_INTERRUPT(TIM0_COMPA_vect);
+
+void _delay_4ms(uint8_t n)
+{
+    uint8_t i;
+
+    OCR0A = 0x80;
+    TIMSK0 |= (1 << OCIE0A);
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    while(n-- > 0) {
+        i = DELAY_4MS_MATCHES;
+        do
+            sleep_mode();
+        while (--i);
+    }
+    TIMSK0 &= ~(1 << OCIE0A);
+}
+#else
 void _delay_4ms(uint8_t n)  // because it saves a bit of ROM space to do it this way
 {
     while(n-- > 0) _delay_loop_2(BOGOMIPS*4);
 }
 #endif
+#endif
 #ifdef USE_DELAY_S
 void _delay_s()  // because it saves a bit of ROM space to do it this way
 {
@@ -0,0 +1,84 @@
+#ifndef TK_OSCCAL_H
+#define TK_OSCCAL_H
+/*
+ * Trim the RC oscillator (OSCCAL) against the watchdog oscillator.
+ *
+ * The factory trim is only good to 10%, and everything we time runs
+ * off that clock: the PWM frequency, and the strobes and blinks
+ * (_delay_4ms() counts timer 0 compare matches, see tk-delay.h).
+ * osccal_tune() counts timer 0 overflows (256 clocks) in one 64 ms
+ * watchdog period (wdt_count() in tk-wdt.h), and steps OSCCAL until
+ * that count is closest to what F_CPU gives.  The watchdog oscillator
+ * isn't trimmed, so the result is only as good as yours is; set
+ * WDT_HZ if you have measured it.
+ *
+ * It steps OSCCAL by one at a time, which is what the datasheet asks:
+ * a jump of more than 2% in the clock can upset the CPU.  A step is
+ * somewhere near 1%, so from 10% out this takes a couple of seconds.
+ * The caller keeps the result in EEPROM and puts it back at power
+ * on, the same way, one step at a time.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <avr/interrupt.h>
+#include "tk-wdt.h"
+
+// Timer 0 overflows in 64 ms (8192 watchdog clocks) at F_CPU
+#define OSCCAL_TARGET   (F_CPU * 32 / WDT_HZ)
+
+// Give up after this many steps, something is wrong
+#define OSCCAL_STEPS    48
+
+/* Call with the light off.  Takes over timer 0 (set_level() puts
+ * the PWM mode back) and the watchdog (off again when done).
+ */
+void
+osccal_tune(void)
+{
+    uint8_t best = OSCCAL;
+    uint8_t i;
+    uint16_t n, d, best_d = 0xffff;
+    int8_t step, dir = 0;
+
+    cli();
+    TCCR0A = 0;                         // normal mode, TOP 0xff
+
+    for (i = 0; i < OSCCAL_STEPS; i++) {
+        n = wdt_count(1 << WDP1);       // 64 ms
+        d = n > OSCCAL_TARGET ? n - OSCCAL_TARGET : OSCCAL_TARGET - n;
+        if (d < best_d) {
+            best_d = d;
+            best = OSCCAL;
+        }
+        step = n > OSCCAL_TARGET ? -1 : 1;
+        if (dir && step != dir)         // crossed over, done
+            break;
+        if ((uint8_t) (OSCCAL + step) > 0x7f)   // end of the range
+            break;
+        dir = step;
+        OSCCAL += step;
+    }
+
+    // Walk back to the closest one
+    while (OSCCAL != best)
+        OSCCAL -= dir;
+
+    sei();
+}
+
+#endif  // TK_OSCCAL_H
@@ -0,0 +1,129 @@
+#ifndef TK_STATS_H
+#define TK_STATS_H
+/*
+ * Usage statistics kept in EEPROM, so a light back from the field
+ * can tell us how it was used.  Read the EEPROM out with
+ *
+ *   avrdude -p t13 -c usbasp -U eeprom:r:stats.hex:i
+ *
+ * and run bin/stats_decode.py on the file.
+ *
+ * They live between the mode index ring (the first half of EEPROM)
+ * and the OPT_* cells at the top:
+ *
+ *   STAT_boots_ones    boots, 0 to 7, one bit cleared for each
+ *   STAT_boots         boots, in eights
+ *   STAT_minutes       minutes on, one counter per level (solid modes
+ *                      only), the last one for that level and up
+ *   STAT_stepdowns     LVP step downs
+ *   STAT_shutdowns     LVP shutdowns
+ *   STAT_minvolt       lowest voltage reading (ADC value)
+ *
+ * The counters are 16 bits, little endian and inverted, so an erased
+ * EEPROM reads as all zero.  The low byte counts down while the high
+ * byte is odd and back up while it is even (stat_fold() flips it), so
+ * an increment only ever rewrites one byte.  Power cut in the middle
+ * of one loses that one count.  A plain counter would write both
+ * bytes every 256 counts, and a cut in between reads back 255 counts
+ * off, or as zero at the first carry.  The write skips the erase when
+ * it only clears bits.  Boots come every click and would wear out a
+ * counter quickest, so they clear one bit at a time in
+ * STAT_boots_ones first, and touch the counter once every 8 boots.
+ * The lowest voltage only ever goes down, so it gets written a few
+ * hundred times at most.
+ *
+ * They are not wear leveled the way the mode index is: a ring for each
+ * counter would need more EEPROM than the chip has.  The datasheet
+ * gives 100,000 write/erase cycles, and a counter stops at 65535
+ * instead of wrapping, so even an erase every count doesn't wear it
+ * out.  A minutes counter stops after some 1090 hours at one level.
+ * STAT_boots_ones takes a write or an erase every boot, so it is the
+ * first to go, after some 100,000 clicks: 27 years at ten a day.
+ *
+ * These read the EEPROM, so they wait for queued writes first.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "tk-eeprom.h"
+
+// bin/stats_decode.py knows this layout, change both together
+#define STAT_BASE       (EEPSIZE/2)
+#define STAT_LEVELS     8
+#define STAT_boots_ones (STAT_BASE)
+#define STAT_boots      (STAT_BASE+1)
+#define STAT_minutes    (STAT_BASE+3)
+#define STAT_stepdowns  (STAT_minutes + 2*STAT_LEVELS)
+#define STAT_shutdowns  (STAT_stepdowns+2)
+#define STAT_minvolt    (STAT_shutdowns+2)
+#define STAT_END        (STAT_minvolt+1)    // first cell past the stats
+
+// Stored counter to plain inverted count and back
+static inline uint16_t
+stat_fold(uint16_t v) {
+    if (! (v & 0x100))
+        v ^= 0xff;
+    return v;
+}
+
+void
+stat_add(uint8_t addr) {
+    uint16_t v;
+    uint8_t i, old, new;
+
+    eep_flush();
+    v = stat_fold(eeprom_read_word((const uint16_t *)addr));
+    if (! v)        // full up, leave it there
+        return;
+    v = stat_fold(v - 1);   // inverted, so one more
+
+    for (i = 0; i < 2; i++, addr++, v >>= 8) {
+        old = eeprom_read_byte((const uint8_t *)addr);
+        new = v;
+        if (new != old)
+            eep_write((new & ~old) ? addr : (addr | EEP_WRITE), new);
+    }
+}
+
+void
+stat_boot() {
+    uint8_t ones;
+
+    eep_flush();
+    ones = eeprom_read_byte((const uint8_t *)STAT_boots_ones);
+    if (ones & (ones - 1)) {
+        // clear the lowest bit still set
+        eep_write(STAT_boots_ones | EEP_WRITE, ones & (ones - 1));
+    } else {
+        // that would have been the last one, start over
+        eep_write(STAT_boots_ones | EEP_ERASE, 0xff);
+        stat_add(STAT_boots);
+    }
+}
+
+// a minute on at a solid mode level, 1 and up
+#define stat_minute(level) \
+    stat_add(STAT_minutes + 2 * (((level) > STAT_LEVELS ? STAT_LEVELS : (level)) - 1))
+
+static inline void
+stat_voltage(uint8_t voltage) {
+    eep_flush();
+    if (voltage < eeprom_read_byte((const uint8_t *)STAT_minvolt))
+        eep_write(STAT_minvolt, voltage);
+}
+
+#endif  // TK_STATS_H
@@ -62,6 +62,14 @@
 // PWM is on pin 6, pin 7 is the ADC battery monitor
 #define PWM_PIN     PB1
 // #define VOLTAGE_PIN PB2
+#define TELEM_PIN   PB3     // STAR4 (pin 2), debug telemetry out
+
+// The stars we don't use, driven low (see tk-power.h)
+#ifdef USE_TELEMETRY
+#define POWER_UNUSED ((1 << PB0) | (1 << PB4))
+#else
+#define POWER_UNUSED ((1 << PB0) | (1 << PB3) | (1 << PB4))
+#endif
 
 #define ADC_CHANNEL 0x01    // MUX 01 corresponds with PB2
 #define ADC_DIDR    ADC1D   // Digital input disable bit corresponding with PB2
@@ -81,6 +89,124 @@
  */
 #define VOLTAGE_MON
 
+/* The main loop used to spin in _delay_4ms(125) between voltage checks,
+ * keeping the CPU running flat out at 4.8 Mhz just to wait.
+ * Now the watchdog timer interrupts us every quarter second and we
+ * spend the time in between in idle sleep.  Timer0 keeps running
+ * in idle mode, so the PWM output is not disturbed.
+ * WDP2 gives 0.25 seconds (see WDT_on() below).
+ */
+#define TICK_WDP    (1 << WDP2)
+#define TICK_HZ     4       // ticks per second
+
+/* Take voltage readings in ADC Noise Reduction sleep mode
+ * rather than busy-polling ADSC (see tk-voltage.h).
+ * Either way every reading is taken with the LED off, the resting
+ * voltage, and ADC_LOW, ADC_RECOVER and ADC_CRIT are resting values.
+ */
+#define USE_ADC_SLEEP
+
+/* Run LVP on an oversampled, median filtered reading (tk-voltage.h).
+ * The filter takes care of the noise, so we no longer need 8 low
+ * readings in a row, and a real sag gets acted on within a couple
+ * of ticks instead of after 4 seconds.
+ */
+#define USE_VOLTAGE_FILTER
+
+#ifdef USE_VOLTAGE_FILTER
+#define LOWBATT_CNT 1       // low readings in a row before we step down
+#else
+#define LOWBATT_CNT 8
+#endif
+#define LVP_WAIT    4       // ticks to let the cell recover after a step down
+
+/* LVP can also step back up, one level at a time, towards the level
+ * the user picked, if the cell comes back up once the current drops.
+ * The voltage has to stay above ADC_RECOVER (well above ADC_LOW, so
+ * we don't just bounce between two levels) for RECOVER_CNT ticks.
+ * Below ADC_CRIT we shut off at once, whatever level we are at.
+ * That is a resting reading, like all of them, so it means an empty
+ * cell, not one with a high resistance that sags at the top level.
+ * Sag only ever takes us down one level at a time, and off from moon
+ * (USE_REST_VOLTAGE, below).
+ */
+#define RECOVER_CNT 40      // 10 seconds
+
+/* Scale the PWM duty up as the cell sags, to make up for the 7135s
+ * dropping out of regulation, so the output holds steady until it
+ * hits full duty.  The curve is COMP_GAINS in tk-calibration.h.
+ * Needs the filtered voltage, a noisy gain would make the light flicker.
+ * Opt-in, off by default, and not in the light as shipped, which dims
+ * as the cell runs down: it doesn't fit in 1K along with the rest
+ * (about 300 bytes).  host/ checks it in biscuit-opt-host.
+ */
+// #define USE_COMPENSATION
+
+#if defined(USE_COMPENSATION) && ! defined(USE_VOLTAGE_FILTER)
+#error "USE_COMPENSATION needs USE_VOLTAGE_FILTER"
+#endif
+
+/* Besides the filtered resting reading, take a burst with the LED on
+ * (tk-voltage.h).  LVP still steps down on the resting voltage, and
+ * also when the loaded one drops below ADC_CRIT, one level at a time.
+ * The difference between the two gives us the cell resistance (see
+ * sag_full), which decides when to step back up.
+ * Opt-in, off by default, and not in the light as shipped, whose LVP
+ * only ever sees the resting reading: it doesn't fit in 1K along with
+ * the rest (about 500 bytes).  host/ checks it in biscuit-opt-host.
+ */
+// #define USE_REST_VOLTAGE
+
+#if defined(USE_REST_VOLTAGE) && ! defined(USE_VOLTAGE_FILTER)
+#error "USE_REST_VOLTAGE needs USE_VOLTAGE_FILTER"
+#endif
+
+/* Keep count of the charge taken out of the cell: every tick, the duty
+ * of the level we are at times CURRENT_FULL_MA (tk-calibration.h).
+ * The count goes to EEPROM every 4 mAh, and the resting voltage at
+ * power on corrects it (a charged cell starts it over).
+ * Ten quick clicks blink out the runtime left at the level you were
+ * on before the clicks, in hours and tenths, then go back to it.
+ * Opt-in, off by default, and not in the light as shipped, which has
+ * no runtime estimate at all: it doesn't fit in 1K along with the
+ * rest (over 1000 bytes).  host/ checks it in biscuit-opt-host.
+ */
+// #define USE_COULOMB
+
+#if defined(USE_COULOMB) && ! defined(VOLTAGE_MON)
+#error "USE_COULOMB needs VOLTAGE_MON"
+#endif
+
+/* Debug builds only ("make TELEMETRY=1"): every tick, send the voltage
+ * reading, lowbatt_cnt, level and a tick count out the STAR4 pad (PB3)
+ * as serial, timed off the PWM overflow (tk-telemetry.h).
+ * Decode it with bin/telemetry_decode.py.
+ */
+// #define USE_TELEMETRY
+
+#if defined(USE_TELEMETRY) && ! defined(VOLTAGE_MON)
+#error "USE_TELEMETRY needs VOLTAGE_MON"
+#endif
+
+/* Keep what we don't use off (tk-power.h): the analog comparator, the
+ * unused star pins, and the ADC between readings.  At LVP shutdown,
+ * wait REBOUND_TICKS with the LED off first.  If the resting voltage
+ * comes back up to ADC_RECOVER, go on at the lowest level, else power
+ * down with the ADC, the watchdog and the BOD off.
+ */
+#define USE_POWER
+#define REBOUND_TICKS   4       // a second
+
+#if defined(USE_POWER) && ! defined(VOLTAGE_MON)
+#error "USE_POWER needs VOLTAGE_MON"
+#endif
+
+/* Halve the system clock at the phase correct levels (moon and low),
+ * where the chip then idles on half the current.  Everything else,
+ * blinks included, runs at full speed (tk-clock.h).
+ */
+#define USE_CLOCK
+
 /*
  * =========================================================================
  */
@@ -92,16 +218,54 @@
 #include <avr/interrupt.h>
 #include <avr/eeprom.h>
 #include <avr/sleep.h>
+#include <avr/wdt.h>
 #include <string.h>
 
 #define OWN_DELAY           // Don't use stock delay functions.
-#define USE_DELAY_4MS
-#define USE_DELAY_S         // Also use _delay_s(), not just _delay_ms()
+// The main loop is paced by the watchdog now, so we don't
+// need these busy-wait delays anymore.
+//#define USE_DELAY_4MS
+//#define USE_DELAY_S         // Also use _delay_s(), not just _delay_ms()
 #include "tk-delay.h"
 
+#ifdef USE_CLOCK
+// Before tk-voltage.h, which sets the ADC prescaler for it
+#include "tk-clock.h"
+#endif
+
 // This also pulls in tk-calibration.h
 #include "tk-voltage.h"
 
+// Change PWM mode and level only between PWM periods
+#define USE_PWM_SYNC
+
+/* Dither the PWM for 12 bit levels, and a real moon mode below
+ * OCR0B = 1 (tk-pwm.h).  Costs a 16 bit level table and an interrupt
+ * every PWM period at moon, so it is opt-in, with a table of its own.
+ */
+// #define USE_PWM_DITHER
+
+#ifdef USE_TELEMETRY
+// Before tk-pwm.h, its overflow interrupt sends the bits
+#include "tk-telemetry.h"
+#endif
+#include "tk-pwm.h"
+
+// Here, after tk-pwm.h, which turns on USE_PWM_SYNC for USE_PWM_DITHER.
+// Without it there is no overflow interrupt, and telem_start() would
+// reset us.
+#if defined(USE_TELEMETRY) && ! defined(USE_PWM_SYNC)
+#error "USE_TELEMETRY needs USE_PWM_SYNC"
+#endif
+
+#ifdef USE_POWER
+#include "tk-power.h"
+#endif
+
+#ifdef USE_COULOMB
+#include "tk-eeprom.h"
+#endif
+
 /*
  * global variables
  */
@@ -119,6 +283,13 @@ uint8_t long_press __attribute__ ((section (".noinit")));
  */
 uint8_t level_idx __attribute__ ((section (".noinit")));
 
+#ifdef USE_COULOMB
+// Short presses in a row, each less than a tick on,
+// and the level we were at before the first one
+uint8_t fast_presses __attribute__ ((section (".noinit")));
+uint8_t click_level __attribute__ ((section (".noinit")));
+#endif
+
 /* The original Biscotti code talked about a FET ramp.
  * This is a historical artifact from other flashlights.
  * The Convoy has no FET, only a set of 7135 chips.
@@ -147,19 +318,65 @@ uint8_t level_idx __attribute__ ((section (".noinit")));
  *
  * I decided on this set of levels for the Convoy
  * 0, 0.4, 2.7, 6, 12.5, 25, 50, 100
+ *
+ * With USE_PWM_DITHER it can get a bit lower after all,
+ * see the second table below.
  */
 
 /* tjt inserts a zero at the start.
+ *
+ * Building with RAMP_ARGS set in the Makefile replaces this table
+ * with one made by ../bin/ramp_calc.py.
+ */
+#ifdef USE_RAMP_H
+#include "ramp.h"
+#if RAMP_FRAC_BITS != PWM_FRAC_BITS
+#error "ramp.h has the wrong number of fraction bits, see RAMP_ARGS"
+#endif
+PROGMEM const pwm_t pwm_values[]  = { 0, RAMP_PWM };
+
+// This includes 0
+#define NUM_LEVELS	(RAMP_SIZE+1)
+#define PHASE_LEVELS	RAMP_PHASE_LEVELS
+#elif defined(USE_PWM_DITHER)
+/* With dithering the values are 8.4 fixed point (16 is one step
+ * of OCR0B).  These are the levels below times 16, except for moon,
+ * which is half of OCR0B = 1: one period in two with the pin high.
+ * 0, 0.2, 2.7, 6, 12.5, 25, 50, 100
  */
+PROGMEM const pwm_t pwm_values[]  = { 0, 8, 112, 240, 512, 1008, 2032, 4080 };
+
+// This includes 0
+#define NUM_LEVELS	8
+#define PHASE_LEVELS	2
+#else
 // PROGMEM const uint8_t pwm_values[]  = { 0, 1, 7, 32, 63, 107, 127, 255 };
 PROGMEM const uint8_t pwm_values[]  = { 0, 1, 7, 15, 32, 63, 127, 255 };
 
 // This includes 0
 #define NUM_LEVELS	8
+#define PHASE_LEVELS	2
+#endif
 
 // number of brightness levels (including 0) in the array
 uint8_t num_levels = NUM_LEVELS;
 
+#ifdef USE_COMPENSATION
+// PWM duty scale factor, 2.6 fixed point (64 is 1.0)
+uint8_t duty_gain = 64;
+#endif
+
+#ifdef USE_REST_VOLTAGE
+// PWM duty we last set, 0-255 (fraction and all)
+uint8_t out_duty;
+
+/* How far the cell sags at full duty, in 8.8 ADC counts.
+ * That is the cell and wiring resistance times the full LED current,
+ * so at about 24 mV per count and 2.8 A, one count is 8.5 milliohms.
+ */
+uint16_t sag_full;
+#endif
+
 /* Note that this wraps around to 1
  * level 0 is off and is used in that way in
  * some parts of this code.
@@ -173,33 +390,357 @@ next_level ( void )
     }
 }
 
+static inline pwm_t
+level_pwm ( uint8_t level )
+{
+#ifdef USE_PWM_DITHER
+	return pgm_read_word ( pwm_values + level );
+#else
+	return pgm_read_byte ( pwm_values + level );
+#endif
+}
+
 /* Call this with a value from 0-7
- *  divide PWM speed by 2 for moon and low,
+ *  divide PWM speed by 2 for moon and low (PHASE_LEVELS),
  *  because the nanjg 105d chips are SLOW
+ * With USE_COMPENSATION the duty gets scaled by duty_gain,
+ *  up to full on.
  */
 void
 set_level ( uint8_t level )
 {
-
-    TCCR0A = PHASE;
+    uint8_t mode = PHASE;
+    pwm_t pwm;
 
     if ( level == 0 ) {
-		PWM_LVL = 0;
+		set_pwm ( mode, 0 );
+#ifdef USE_REST_VOLTAGE
+		out_duty = 0;
+#endif
 		return;
     }
 
-	if (level > 2)
-		TCCR0A = FAST;
+	if (level > PHASE_LEVELS)
+		mode = FAST;
+
+#ifdef USE_CLOCK
+	clock_set ( mode == FAST ? 0 : CLOCK_SLOW );
+#endif
+
+	pwm = level_pwm ( level );
+
+#ifdef USE_COMPENSATION
+	{
+	    uint32_t scaled = ((uint32_t) pwm * duty_gain) >> 6;
+
+	    if ( scaled > (255 << PWM_FRAC_BITS) )
+		scaled = 255 << PWM_FRAC_BITS;
+	    pwm = scaled;
+	}
+#endif
+
+	// Both at once, at the end of a PWM period (tk-pwm.h)
+	set_pwm ( mode, pwm );
+#ifdef USE_REST_VOLTAGE
+	out_duty = pwm >> PWM_FRAC_BITS;
+#endif
+}
+
+#ifdef USE_REST_VOLTAGE
+/* Work out sag_full from a resting and a loaded reading.
+ * Only called at a decent duty, where the sag is well above the
+ * noise, and smoothed a bit, since the loaded burst isn't filtered.
+ */
+static inline void
+update_sag ( uint16_t rest, uint16_t loaded )
+{
+    uint16_t sag;
+
+    if ( loaded >= rest )
+        return;
+
+    sag = ((uint32_t) (rest - loaded) * 255) / out_duty;
+    if ( sag_full )
+        sag = sag_full - (sag_full >> 2) + (sag >> 2);
+    sag_full = sag;
+}
+
+/* The loaded voltage we'd expect at this level, given the sag
+ * we've seen (ignoring any compensation gain)
+ */
+static inline uint16_t
+predict_loaded ( uint16_t rest, uint8_t level )
+{
+    uint8_t duty = level_pwm ( level ) >> PWM_FRAC_BITS;
+    uint16_t sag = ((uint32_t) sag_full * duty) >> 8;
+
+    return rest > sag ? rest - sag : 0;
+}
+#endif
+
+#ifdef USE_COULOMB
+/* The charge used is counted in units of COUL_MAH.
+ * COUL_UNIT is how much PWM table value (summed once a tick)
+ * makes one unit.
+ */
+#define COUL_MAH        4
+#define COUL_FULL       (CAPACITY_MAH / COUL_MAH)
+#define COUL_QUARTER    (COUL_FULL / 4)
+#define COUL_UNIT       ((uint32_t) COUL_MAH * 3600 * TICK_HZ * \
+                         (255UL << PWM_FRAC_BITS) / CURRENT_FULL_MA)
+
+/* The count lives in a ring of COUL_LOG_LEN 16 bit entries at the
+ * start of EEPROM, with the entry after the newest one always erased.
+ * A save erases the one after next, then writes the next one, high
+ * byte last (the high byte of a count is never 0xff).  So a power cut
+ * at any point leaves us with either the old count or the new one.
+ * A cut between the two bytes leaves the low byte of the next entry
+ * written, so that one gets a full erase and write, not write-only.
+ * Each save wears one entry, so with 16 of them the EEPROM is good
+ * for some 6000 Ah.
+ */
+#define COUL_LOG_LEN    16      // must be a power of 2
+
+uint16_t coul_used;     // charge taken out, in COUL_MAH units
+uint32_t coul_acc;      // table value summed towards the next unit
+uint8_t coul_pos;       // newest entry in the ring
+
+static inline uint16_t
+coul_read ( uint8_t pos )
+{
+    return eeprom_read_word ( (const uint16_t *) (pos << 1) );
+}
+
+#define coul_valid(x)   (((x) >> 8) != 0xff)
+
+// Find the newest count, a blank EEPROM means a full cell
+static inline void
+coul_restore ( void )
+{
+    uint8_t i;
+    uint16_t used;
+
+    coul_pos = COUL_LOG_LEN - 1;
+    for ( i = 0; i < COUL_LOG_LEN; i++ ) {
+        used = coul_read ( i );
+        if ( coul_valid ( used ) &&
+             ! coul_valid ( coul_read ( (i+1) & (COUL_LOG_LEN-1) ) ) ) {
+            coul_pos = i;
+            if ( used > COUL_FULL )
+                used = COUL_FULL;
+            coul_used = used;
+            return;
+        }
+    }
+}
+
+static void
+coul_save ( void )
+{
+    uint8_t next = (coul_pos + 1) & (COUL_LOG_LEN-1);
+    uint8_t addr = ((next + 1) & (COUL_LOG_LEN-1)) << 1;
+
+    eep_write ( addr | EEP_ERASE, 0xff );
+    eep_write ( (addr+1) | EEP_ERASE, 0xff );
+    addr = next << 1;
+    eep_write ( addr, coul_used );
+    eep_write ( addr+1, coul_used >> 8 );
+    coul_pos = next;
+}
+
+// Once a tick, for the level we are putting out
+static inline void
+coul_tick ( uint8_t level )
+{
+    coul_acc += level_pwm ( level );
+    if ( coul_acc >= COUL_UNIT ) {
+        coul_acc -= COUL_UNIT;
+        if ( coul_used < COUL_FULL ) {
+            coul_used++;
+            coul_save ();
+        }
+    }
+}
+
+/* The resting voltage only tells us the charge to within 25%
+ * (the ADC_*p values), so leave the count alone unless it is
+ * outside that.  Above ADC_FULL the cell is full, below ADC_0p empty.
+ */
+PROGMEM const uint8_t coul_volts[] = {
+    ADC_0p, ADC_25p, ADC_50p, ADC_75p, ADC_FULL
+};
+
+static inline void
+coul_correct ( uint8_t voltage )
+{
+    uint8_t i;
+    uint16_t lo, hi, used = coul_used;
+
+    for ( i = 0; i < sizeof(coul_volts) &&
+                 voltage >= pgm_read_byte ( coul_volts + i ); i++ ) ;
+
+    // i quarters of the cell are left, give or take one
+    hi = (uint8_t) (5 - i) * COUL_QUARTER;
+    lo = i < 5 ? hi - COUL_QUARTER : 0;
+    if ( hi > COUL_FULL )
+        hi = COUL_FULL;
+
+    if ( used < lo )
+        used = lo;
+    if ( used > hi )
+        used = hi;
+    if ( used != coul_used ) {
+        coul_used = used;
+        coul_acc = 0;
+        coul_save ();
+    }
+}
+
+/* Runtime left at a level, in tenths of an hour, up to 99.9 hours.
+ * That is the charge left over the duty times CURRENT_FULL_MA.
+ */
+static uint16_t
+coul_runtime ( uint8_t level )
+{
+    uint32_t left = (uint32_t) (COUL_FULL - coul_used) *
+                    (COUL_MAH * 10 * (255UL << PWM_FRAC_BITS));
+    uint32_t t = left / ((uint32_t) level_pwm ( level ) * CURRENT_FULL_MA);
+
+    return t > 999 ? 999 : t;
+}
+#endif  // USE_COULOMB
+
+/* The watchdog runs in interrupt mode only (WDE stays clear),
+ * so it never resets the chip, it just wakes us up.
+ * The timed sequence is the one from the datasheet.
+ */
+static inline void
+WDT_on ( void )
+{
+    cli();
+    wdt_reset();
+    WDTCR |= (1 << WDCE) | (1 << WDE);  // Start timed sequence
+    WDTCR = (1 << WDTIE) | TICK_WDP;    // Interrupt every tick
+    sei();
+}
+
+volatile uint8_t tick;
+
+ISR ( WDT_vect )
+{
+    tick = 1;
+}
+
+/* Idle sleep until the next watchdog tick.
+ * Other interrupts may wake us early, in which case we
+ * just go back to sleep.
+ * Note that "sei" always executes the following instruction
+ * before any pending interrupt, so the tick can't sneak in
+ * between the test and the sleep instruction.
+ */
+void
+wait_tick ( void )
+{
+    set_sleep_mode ( SLEEP_MODE_IDLE );
+    cli();
+    while ( ! tick ) {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        cli();
+    }
+    sleep_disable();
+    tick = 0;
+    sei();
+}
+
+static void
+wait_ticks ( uint8_t n )
+{
+    while ( n-- )
+        wait_tick ();
+}
 
-	PWM_LVL = pgm_read_byte ( pwm_values + level );
+/* Turn off for good, until the next click.
+ * With USE_POWER we only return if the cell came back up
+ * with the LED off, the caller goes on at the lowest level.
+ */
+static void
+power_off ( void )
+{
+    set_level ( 0 );
+    pwm_wait ();
+#ifdef USE_POWER
+    wait_ticks ( REBOUND_TICKS );
+    adc_wake ();
+    if ( get_voltage () >= ADC_RECOVER ) {
+        adc_sleep ();
+        return;
+    }
+    level_idx = 0;
+    power_down ();
+#else
+    level_idx = 0;
+    // Power down as many components as possible
+    // With interrupts off, the watchdog can't wake us.
+    cli();
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_mode();
+#endif
+    /* NOTREACHED */
 }
 
+#ifdef USE_COULOMB
+// Blinks are about as bright as the middle level
+#define BLINK_LEVEL	(NUM_LEVELS / 2 + 1)
+
+/* Blink one digit, a quarter second on and a half off each.
+ * A zero is a single blink at the lowest level.
+ */
+static void
+blink_digit ( uint8_t n )
+{
+    uint8_t level = BLINK_LEVEL;
+
+    if ( n == 0 ) {
+        n = 1;
+        level = 1;
+    }
+    while ( n-- ) {
+        set_level ( level );
+        wait_ticks ( 1 );
+        set_level ( 0 );
+        wait_ticks ( 2 );
+    }
+    wait_ticks ( 4 );
+}
+
+/* Blink out the runtime left at a level, hours first,
+ * then a longer gap and the tenths
+ */
+static void
+runtime_readout ( uint8_t level )
+{
+    uint16_t t = coul_runtime ( level );
+
+    if ( t >= 100 )
+        blink_digit ( t / 100 );
+    blink_digit ( (t / 10) % 10 );
+    wait_ticks ( 4 );
+    blink_digit ( t % 10 );
+}
+#endif
+
 int
 main(void)
 {
     // Assign PWM pin to output
     DDRB |= (1 << PWM_PIN);     // enable main channel
 
+#ifdef USE_POWER
+    power_init ();
+#endif
+
     // Set timer to do PWM for correct output pin and set prescaler timing
     //TCCR0A = 0x23; // phase corrected PWM is 0x21 for PB1, fast-PWM is 0x23
     //TCCR0B = 0x01; // pre-scaler for timer (1 => 1, 2 => 8, 3 => 64...)
@@ -214,80 +755,231 @@ main(void)
 	 *  off for days or weeks.
 	 */
 
-	if ( long_press == 0 && level_idx < num_levels )
+#ifdef USE_COULOMB
+    // Only a cell that has been resting tells us its charge
+    uint8_t rested = 0;
+#endif
+
+	if ( long_press == 0 && level_idx < num_levels ) {
+#ifdef USE_COULOMB
+		if ( fast_presses == 0 )
+			click_level = level_idx;
+		fast_presses = (fast_presses+1) & 0x1f;
+#endif
 		next_level ();
-	else
+	} else {
 		level_idx = 1;
+#ifdef USE_COULOMB
+		fast_presses = 0;
+		rested = 1;
+#endif
+	}
 
     long_press = 0;
 
+    // Light up first, everything else can wait
+	set_level ( level_idx );
+
+#ifdef USE_COULOMB
+    coul_restore ();
+#endif
+
     // Turn features on or off as needed
 	// tjt - we DO use this
     #ifdef VOLTAGE_MON
     ADC_on();
+    #ifdef USE_POWER
+    adc_sleep();    // set up, on only for the readings
+    #endif
     #else
     ADC_off();
     #endif
 
 #ifdef VOLTAGE_MON
     uint8_t lowbatt_cnt = 0;
-    // uint8_t i = 0;
+    uint8_t highbatt_cnt = 0;
+    uint8_t lvp_wait = 0;
+    // What LVP lets us put out, level_idx stays what the user picked
+    uint8_t out_level = level_idx;
     uint8_t voltage;
-    // Make sure voltage reading is running for later
-    ADCSRA |= (1 << ADSC);
+#ifdef USE_VOLTAGE_FILTER
+    uint16_t fvoltage;
+#endif
+#ifdef USE_REST_VOLTAGE
+    uint16_t lvoltage;
+#endif
 #endif
 
-    // Regular brightness level
-	set_level ( level_idx );
+#ifdef USE_TELEMETRY
+    telem_init ();
+#endif
+
+    WDT_on ();
+
+#ifdef USE_COULOMB
+    // Ten quick clicks, tell how long the old level will last
+    if ( fast_presses > 9 ) {
+        fast_presses = 0;
+        level_idx = click_level;
+        runtime_readout ( level_idx );
+        out_level = level_idx;
+        set_level ( level_idx );
+    }
+#endif
 
     while(1) {
 
-		// do we need this to pace the voltage monitor?
-		_delay_4ms(125);
+		// Sleep until the watchdog paces the voltage monitor
+		wait_tick ();
+
+#ifdef USE_COULOMB
+		// On for a tick, this wasn't a quick click
+		fast_presses = 0;
+#endif
 
 // tjt - we DO use this
 #ifdef VOLTAGE_MON
-        if (ADCSRA & (1 << ADIF)) {  // if a voltage reading is ready
-            voltage = ADCH;  // get the waiting value
-
-            // See if voltage is lower than what we were looking for
-            if (voltage < ADC_LOW) {
-                lowbatt_cnt ++;
-            } else {
-                lowbatt_cnt = 0;
+#ifdef USE_POWER
+        adc_wake ();
+#endif
+        // Take a reading (this sleeps through the conversion)
+#ifdef USE_VOLTAGE_FILTER
+        fvoltage = get_filtered_voltage ();
+        voltage = fvoltage >> 8;
+#ifdef USE_REST_VOLTAGE
+        // fvoltage is at rest, this one is under load.  Not below
+        // 1/4 duty, where there's little sag to see, and in ADC sleep
+        // the pin would sit high for the whole burst, which shows
+        // as a blip at moon.  The resting reading does for both.
+        lvoltage = fvoltage;
+        if ( out_duty >= 64 ) {
+            lvoltage = get_loaded_voltage ();
+            update_sag ( fvoltage, lvoltage );
+        }
+#endif
+#else
+        voltage = get_voltage ();
+#endif
+#ifdef USE_POWER
+        adc_sleep ();
+#endif
+
+#ifdef USE_COMPENSATION
+        // Follow the sag, but only touch the PWM when the gain changes
+        {
+#ifdef USE_REST_VOLTAGE
+            // The 7135s drop out on the loaded voltage
+            uint8_t gain = comp_gain ( lvoltage );
+#else
+            // All we have, COMP_GAINS wants measuring against it
+            uint8_t gain = comp_gain ( fvoltage );
+#endif
+
+            if ( gain != duty_gain ) {
+                duty_gain = gain;
+                set_level ( out_level );
             }
+        }
+#endif
+
+#ifdef USE_COULOMB
+        if ( rested ) {
+            rested = 0;
+            coul_correct ( voltage );
+        }
+        coul_tick ( out_level );
+#endif
+
+        // Too low to go on at any level (at rest, so the cell
+        // really is flat, see RECOVER_CNT)
+        if ( voltage < ADC_CRIT ) {
+            power_off ();
+            // It came back up, see power_off()
+            out_level = 1;
+            set_level ( out_level );
+            lvp_wait = LVP_WAIT;
+        }
+
+        // See if voltage is lower than what we were looking for
+        // (or sags too far under load at this level)
+#ifdef USE_REST_VOLTAGE
+        if (voltage < ADC_LOW || (lvoltage >> 8) < ADC_CRIT) {
+#else
+        if (voltage < ADC_LOW) {
+#endif
+            lowbatt_cnt ++;
+        } else {
+            lowbatt_cnt = 0;
+        }
 
-            // See if it's been low for a while, and maybe step down
-            if (lowbatt_cnt >= 8) {
-                // DEBUG: blink on step-down:
-                //set_level(0);  _delay_ms(100);
-
-                if ( level_idx > 1) {  // regular solid mode
-                    // step down from solid modes somewhat gradually
-                    // drop by 25% each time
-                    level_idx = level_idx - 1;
-                    // drop by 50% each time
-                    // level_idx = (level_idx >> 1);
-                } else { // Already at the lowest mode
-                    // Turn off the light
-					level_idx = 0;
-                    set_level ( 0 );
-                    // Power down as many components as possible
-                    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
-                    sleep_mode();
-					/* NOTREACHED */
-                }
-
-                set_level ( level_idx );
-
-                lowbatt_cnt = 0;
-                // Wait before lowering the level again
-                _delay_s();
+        // ... or has come back up
+        if (voltage >= ADC_RECOVER) {
+            if ( highbatt_cnt < RECOVER_CNT )
+                highbatt_cnt ++;
+        } else {
+            highbatt_cnt = 0;
+        }
+
+        // Keep sampling, but don't act on it, while the cell
+        // settles after the last change
+        if ( lvp_wait ) {
+            lvp_wait--;
+            lowbatt_cnt = 0;
+            highbatt_cnt = 0;
+        }
+
+#ifdef USE_TELEMETRY
+        // What this tick saw, before we act on it
+#ifdef USE_VOLTAGE_FILTER
+        telem_frame ( fvoltage, lowbatt_cnt, out_level | (level_idx << 4) );
+#else
+        telem_frame ( voltage << 8, lowbatt_cnt, out_level | (level_idx << 4) );
+#endif
+#endif
+
+        // See if it's been low for a while, and maybe step down
+        if (lowbatt_cnt >= LOWBATT_CNT) {
+            // DEBUG: blink on step-down:
+            //set_level(0);  _delay_ms(100);
+
+            if ( out_level > 1) {  // regular solid mode
+                // step down from solid modes somewhat gradually
+                // drop by 25% each time
+                out_level = out_level - 1;
+                // drop by 50% each time
+                // out_level = (out_level >> 1);
+            } else { // Already at the lowest mode
+                power_off ();
             }
 
-            // Make sure conversion is running for next time through
-            ADCSRA |= (1 << ADSC);
+            set_level ( out_level );
+
+            lowbatt_cnt = 0;
+            // Wait before changing the level again
+            lvp_wait = LVP_WAIT;
+
+        // Or if it's been fine for a good while, step back up
+#ifdef USE_REST_VOLTAGE
+        // ... and the next level up won't just sag us back down
+        } else if (highbatt_cnt >= RECOVER_CNT && out_level < level_idx &&
+                   (predict_loaded ( fvoltage, out_level + 1 ) >> 8) >= ADC_LOW) {
+#else
+        } else if (highbatt_cnt >= RECOVER_CNT && out_level < level_idx) {
+#endif
+            out_level = out_level + 1;
+            set_level ( out_level );
+
+            highbatt_cnt = 0;
+            lvp_wait = LVP_WAIT;
         }
+
+#ifdef USE_TELEMETRY
+        // After any level change, and once its PWM mode is in: set_level()
+        // changes the clock at once but TCCR0A only an overflow later,
+        // and the frame has to go out at one bit rate
+        pwm_mode_wait ();
+        telem_start ();
+#endif
 #endif  // ifdef VOLTAGE_MON
 
     } /* end of forever loop */
@@ -0,0 +1,73 @@
+#ifndef TK_CLOCK_H
+#define TK_CLOCK_H
+/*
+ * System clock scaling, with the clock prescaler (CLKPR).
+ *
+ * The chip spends nearly all of its time in idle sleep, where its
+ * current goes with the clock, about 0.3 mA at 4.8 MHz and 3 V.  At
+ * moon that is a good part of what the whole light draws.
+ * clock_set() divides the system clock by (1 << div).
+ *
+ * Timer 0 already runs at clk/1, so there is no faster timer
+ * prescale to make up for a slower clock, and the PWM frequency
+ * drops with it.  So we only slow down at the levels that already
+ * use phase correct PWM: halved, that goes from 9.4 to 4.7 kHz with
+ * the same duty, and twice as long pulses suit the slow 7135s.
+ * A dithered level repeats within 16 periods, so not much of it is
+ * slower than 300 Hz.  Divide any further and that would start to show.
+ *
+ * The ADC prescaler changes along with the clock, so the ADC clock
+ * stays F_CPU / (1 << ADC_PRSCL), 75 kHz, inside its 50-200 kHz.
+ * With USE_POWER the ADC is stopped (PRR) between readings, and a
+ * write to ADCSRA then is lost, so adc_wake() sets it instead.
+ * The watchdog and EEPROM timing have their own oscillators, they
+ * don't change.  Anything that counts cycles (tk-delay.h) would, so
+ * call clock_set(0) before those.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <avr/interrupt.h>
+
+#ifndef CLOCK_SLOW
+#define CLOCK_SLOW  1           // log2 of the divisor at the slow levels
+#endif
+
+uint8_t clock_div;              // log2 of the divisor we run at now
+
+static inline void
+clock_set(uint8_t div) {
+    uint8_t sreg;
+
+    if (div == clock_div)
+        return;
+    clock_div = div;
+
+    // Timed sequence, the second write within 4 cycles
+    sreg = SREG;
+    cli();
+    CLKPR = (1 << CLKPCE);
+    CLKPR = div;
+    SREG = sreg;
+
+#ifndef USE_POWER
+    // Keep the ADC clock where it was
+    ADCSRA = (ADCSRA & ~7) | (ADC_PRSCL - div);
+#endif
+}
+
+#endif  // TK_CLOCK_H
@@ -0,0 +1,97 @@
+#ifndef TK_POWER_H
+#define TK_POWER_H
+/*
+ * Power management, keep off whatever we don't use.
+ *
+ * power_init() at power on turns off the analog comparator, which
+ * nothing here uses, and makes the unused pins in POWER_UNUSED
+ * outputs, driven low.  A floating input costs current while the
+ * CPU runs or idles (in power down the input buffers are clamped
+ * anyway).  The datasheet suggests pull-ups for unused pins, but on
+ * the NANJG boards a star pad may be soldered to ground, and a
+ * pull-up into that draws some 100 uA for good.  Driven low, a
+ * grounded star costs nothing.
+ *
+ * The ADC draws a couple of hundred uA whenever it is enabled, in any
+ * sleep mode too.  adc_sleep() turns it off and stops its clock (PRR),
+ * adc_wake() brings it back for the next reading.  The first conversion
+ * after that takes 25 ADC clocks instead of 13, which covers the start
+ * up time of the bandgap reference.
+ *
+ * power_down() is the last thing LVP does.  Call it with the LED off.
+ * It turns off everything that keeps drawing in power down: the ADC and
+ * its reference, and the watchdog, which would also wake us again.  The
+ * BOD is off for the length of the sleep as well, if the fuses turn it
+ * on (the Makefiles leave it off).  That needs an ATtiny13A, which has
+ * BODCR, and the Makefiles build for it (-mmcu=attiny13a), so PRR,
+ * BODCR and sleep_bod_disable() come from avr-libc.  A plain ATtiny13
+ * has no way to do it.  What is left is the chip's leakage, well under a
+ * microamp, so a light left switched on after LVP goes on losing charge
+ * mostly through the voltage divider on the ADC pin.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+static inline void
+power_init(void) {
+    ACSR = (1 << ACD);          // analog comparator off
+#ifndef VOLTAGE_MON
+    PRR = (1 << PRADC);         // never used, never on
+#endif
+#ifdef POWER_UNUSED
+    DDRB |= POWER_UNUSED;       // PORTB is 0 from reset, so low
+#endif
+}
+
+static inline void
+adc_sleep(void) {
+    ADCSRA &= ~(1 << ADEN);     // it has to be off before PRR stops it
+    PRR = (1 << PRADC);
+}
+
+static inline void
+adc_wake(void) {
+    PRR = 0;
+#ifdef USE_CLOCK
+    // The prescaler for the clock we run at now: clock_set() can't
+    // write it while PRR has the ADC stopped (tk-clock.h)
+    ADCSRA = (1 << ADEN) | (ADC_PRSCL - clock_div);
+#else
+    ADCSRA |= (1 << ADEN);
+#endif
+}
+
+/* Off for good, only a power cycle (a click) gets us out of this
+ */
+static inline void
+power_down(void) {
+    cli();
+    adc_sleep();
+    TCCR0A = 0;                         // PWM pin back to PORTB, low
+    WDTCR |= (1 << WDCE) | (1 << WDE);  // Start timed sequence
+    WDTCR = 0;                          // watchdog off
+    set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+    sleep_enable();
+    sleep_bod_disable();
+    sleep_cpu();
+    /* NOTREACHED */
+}
+
+#endif  // TK_POWER_H
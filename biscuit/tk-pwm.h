@@ -0,0 +1,162 @@
+#ifndef TK_PWM_H
+#define TK_PWM_H
+/*
+ * Glitch-free PWM level changes.
+ *
+ * OCR0B is double buffered by the hardware, but TCCR0A is not.
+ * Switching between phase correct and fast PWM part way through a
+ * period can put out a runt pulse, or one that is a whole period
+ * long, which shows as a blip when LVP steps down or when we blink.
+ *
+ * With USE_PWM_SYNC, set_pwm() just notes the new mode and level,
+ * and the timer 0 overflow interrupt puts them in, in two steps.
+ * At one overflow it writes OCR0B, which the hardware only takes at
+ * the next TOP (phase correct) or BOTTOM (fast PWM).  At the overflow
+ * after that, at BOTTOM, where both modes have the pin high until the
+ * up-counting compare match, it switches TCCR0A.  So the new mode
+ * never runs a period with the old level: at worst the period in
+ * between is half old level, half new, in the old mode.  A change of
+ * level alone takes the one overflow.  The interrupt is only enabled
+ * while a change is pending, so it costs nothing the rest of the time.
+ * Interrupts must be enabled (sei) for changes to happen.  The
+ * first set_pwm() after power on, with TCCR0A still 0, takes effect
+ * at once: the light isn't on to blip.
+ *
+ * Before PWR_DOWN sleep (which stops the timer) use pwm_wait()
+ * to let the last change go through, and to be sure the light is
+ * off, clear TCCR0A too: the new OCR0B may not have latched yet.
+ *
+ * USE_PWM_DITHER goes further and takes levels with PWM_FRAC_BITS
+ * of fraction.  The overflow interrupt then stays on and runs a
+ * first order sigma-delta: each period it adds the fraction to an
+ * accumulator, and the periods where that carries get OCR0B one
+ * step higher.  So 1.25 is OCR0B 1 for three periods and 2 for one,
+ * and averaged over a few periods the duty has 12 bits instead of 8.
+ * At the bottom end, where one step of 8 bits is a big jump, that
+ * gets us levels in between and a real moon mode.  The cost is an
+ * interrupt every PWM period, but only while the level has a
+ * fraction.
+ *
+ * USE_TELEMETRY (tk-telemetry.h, included before this) also sends a
+ * bit of its frame from the overflow interrupt, and keeps it on
+ * until the frame is out.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <avr/interrupt.h>
+
+#ifdef USE_PWM_DITHER
+#ifndef USE_PWM_SYNC
+#define USE_PWM_SYNC
+#endif
+#define PWM_FRAC_BITS 4
+typedef uint16_t pwm_t;         // 8.4 fixed point
+#else
+#define PWM_FRAC_BITS 0
+typedef uint8_t pwm_t;
+#endif
+
+#ifdef USE_PWM_SYNC
+
+#ifdef USE_TELEMETRY
+#define pwm_idle()  (! telem_busy())
+#else
+#define pwm_idle()  1
+#endif
+
+volatile uint8_t pwm_mode;      // TCCR0A to switch to
+volatile uint8_t pwm_level;     // OCR0B for the next period
+uint8_t pwm_tccr;               // TCCR0A for the next overflow
+
+#ifdef USE_PWM_DITHER
+volatile uint8_t pwm_frac;      // fraction of a step, out of 256
+uint8_t pwm_acc;                // sigma-delta accumulator
+#endif
+
+ISR(TIM0_OVF_vect)
+{
+    // Goes with the OCR0B from the last overflow, which has latched
+    uint8_t mode = pwm_tccr;
+
+    TCCR0A = mode;
+    pwm_tccr = pwm_mode;
+#ifdef USE_TELEMETRY
+    telem_bit();
+#endif
+#ifdef USE_PWM_DITHER
+    uint8_t level = pwm_level;
+    uint8_t acc = pwm_acc + pwm_frac;
+
+    if (acc < pwm_acc)          // carried, this period gets one more
+        level++;
+    pwm_acc = acc;
+    PWM_LVL = level;
+    if (! pwm_frac && mode == pwm_mode && pwm_idle())
+        TIMSK0 &= ~(1 << TOIE0);
+#else
+    PWM_LVL = pwm_level;
+    if (mode == pwm_mode && pwm_idle())
+        TIMSK0 &= ~(1 << TOIE0);
+#endif
+}
+
+void
+set_pwm(uint8_t mode, pwm_t level)
+{
+    TIMSK0 &= ~(1 << TOIE0);    // hold off the interrupt while we change these
+    pwm_mode = mode;
+#ifdef USE_PWM_DITHER
+    pwm_level = level >> PWM_FRAC_BITS;
+    pwm_frac = level << (8 - PWM_FRAC_BITS);
+#else
+    pwm_level = level;
+#endif
+    if (! TCCR0A) {
+        // The pin isn't on the timer yet (as at power on),
+        // so there is no period to cut short: light up now
+        PWM_LVL = pwm_level;
+        TCCR0A = pwm_tccr = mode;
+    }
+    TIFR0 = (1 << TOV0);        // only an overflow from now on counts
+    TIMSK0 |= (1 << TOIE0);
+}
+
+// wait for a pending change to go through
+// (with dithering, only once the level has no fraction, like 0)
+#define pwm_wait()  while (TIMSK0 & (1 << TOIE0))
+
+// wait for just a new mode to be in TCCR0A, an overflow or two after
+// set_pwm(), where pwm_wait() would also wait out the dithering
+#define pwm_mode_wait() \
+    while (TCCR0A != pwm_mode && (TIMSK0 & (1 << TOIE0)))
+
+#else
+
+static inline void
+set_pwm(uint8_t mode, pwm_t level)
+{
+    TCCR0A = mode;
+    PWM_LVL = level;
+}
+
+#define pwm_wait()
+#define pwm_mode_wait()
+
+#endif  // USE_PWM_SYNC
+
+#endif  // TK_PWM_H
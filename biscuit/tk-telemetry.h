@@ -0,0 +1,128 @@
+#ifndef TK_TELEMETRY_H
+#define TK_TELEMETRY_H
+/*
+ * Debug telemetry, sent out a spare pin as plain async serial
+ * (8 data bits, no parity, 1 stop bit, LSB first, idle high).
+ *
+ * There is no UART on the ATtiny13A, and no timer to spare, so this
+ * rides on the timer 0 overflow interrupt in tk-pwm.h: one bit per
+ * PWM period.  That makes the bit rate F_CPU/256 (18750 baud) in fast
+ * PWM and F_CPU/510 (about 9412) in phase correct, half that again
+ * with USE_CLOCK (tk-clock.h), and it can change from one tick to the
+ * next as the level does.  Within a frame it can't: the clock changes
+ * as soon as the level does, but the PWM mode an overflow later, so
+ * biscuit.c only starts one after pwm_mode_wait().  Every frame starts
+ * with a 0x55 sync byte, whose edges are one bit apart, so the
+ * decoder measures the bit time from that.
+ *
+ * Once per main loop pass the frame is:
+ *
+ *   0   0x55 sync
+ *   1   tick, counts loop passes and wraps
+ *   2   ADC reading, fraction (8.8, see tk-voltage.h)
+ *   3   ADC reading, whole part
+ *   4   lowbatt_cnt
+ *   5   level, out_level in the low nibble, level_idx in the high
+ *   6   check, bytes 1 to 6 add up to 0
+ *
+ * bin/telemetry_decode.py reads this back from a logic analyser
+ * capture.
+ *
+ * TELEM_PIN defaults to PB3, the STAR4 pad on the NANJG layout.
+ * Leave that star pad open, or the pin drives straight into ground.
+ * A frame takes 3.7 to 15 ms, well inside a 250 ms tick, and has to
+ * be done before the next voltage reading, which stops the timer
+ * interrupt (see rest_begin() in tk-voltage.h).
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TELEM_PIN
+#define TELEM_PIN   PB3
+#endif
+
+// bin/telemetry_decode.py knows this layout, change both together
+#define TELEM_SYNC  0x55
+#define TELEM_LEN   7
+
+uint8_t telem_buf[TELEM_LEN];
+uint8_t telem_tick;
+volatile uint8_t telem_left;    // bytes still to start
+volatile uint8_t telem_bits;    // bits still to go of this one
+uint8_t telem_byte;             // what is left of it, LSB next
+
+// Test telem_left first, the interrupt may start the last byte in between
+#define telem_busy()    (telem_left || telem_bits)
+
+// Called from the timer 0 overflow interrupt, puts out the next bit
+static inline void
+telem_bit(void) {
+    if (! telem_bits) {
+        if (! telem_left)
+            return;
+        telem_byte = telem_buf[TELEM_LEN - telem_left];
+        telem_left--;
+        telem_bits = 9;
+        PORTB &= ~(1 << TELEM_PIN);         // start bit
+        return;
+    }
+    if (telem_byte & 1)
+        PORTB |= (1 << TELEM_PIN);
+    else
+        PORTB &= ~(1 << TELEM_PIN);
+    telem_byte = (telem_byte >> 1) | 0x80;  // the ones shifted in end as the stop bit
+    telem_bits--;
+}
+
+static inline void
+telem_init(void) {
+    PORTB |= (1 << TELEM_PIN);      // idle high
+    DDRB |= (1 << TELEM_PIN);
+}
+
+/* Fill in the frame, but don't send it yet.
+ * If the last one is still going out, this one is dropped,
+ * and the gap shows in the tick count.
+ */
+void
+telem_frame(uint16_t adc, uint8_t lowbatt, uint8_t level) {
+    uint8_t i, sum = 0;
+
+    telem_tick++;
+    if (telem_busy())
+        return;
+    telem_buf[0] = TELEM_SYNC;
+    telem_buf[1] = telem_tick;
+    telem_buf[2] = adc;
+    telem_buf[3] = adc >> 8;
+    telem_buf[4] = lowbatt;
+    telem_buf[5] = level;
+    for (i = 1; i < TELEM_LEN - 1; i++)
+        sum += telem_buf[i];
+    telem_buf[TELEM_LEN - 1] = -sum;
+}
+
+// Start sending this tick's frame, the overflow interrupt does the rest
+static inline void
+telem_start(void) {
+    if (telem_busy() || telem_buf[1] != telem_tick)
+        return;
+    telem_left = TELEM_LEN;
+    TIMSK0 |= (1 << TOIE0);
+}
+
+#endif  // TK_TELEMETRY_H
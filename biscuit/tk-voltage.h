@@ -28,6 +28,7 @@ static inline void
 ADC_on_temperature() {
     // TODO: (?) enable ADC Noise Reduction Mode, Section 17.7 on page 128
     //       (apparently can only read while the CPU is in idle mode though)
+    //       get_voltage() does this when USE_ADC_SLEEP is defined.
     // select ADC4 by writing 0b00001111 to ADMUX
     // 1.1v reference, left-adjust, ADC4
     ADMUX  = (1 << V_REF) | (1 << ADLAR) | TEMP_CHANNEL;
@@ -46,10 +47,57 @@ ADC_on() {
     // 1.1v reference, left-adjust, ADC1/PB2
     ADMUX  = (1 << V_REF) | (1 << ADLAR) | ADC_CHANNEL;
     // enable, start, prescale
+#ifdef USE_CLOCK
+    // for the clock we run at now (tk-clock.h)
+    ADCSRA = (1 << ADEN ) | (1 << ADSC ) | (ADC_PRSCL - clock_div);
+#else
     ADCSRA = (1 << ADEN ) | (1 << ADSC ) | ADC_PRSCL;
+#endif
 }
 
-uint8_t get_voltage() {
+/* Every reading LVP goes by is a resting one, with the LED off.
+ * For the length of a conversion we take the PWM pin away from the
+ * timer, so it is driven by PORTB, which is 0.  That is a dark gap
+ * of well under a millisecond, which nobody can see, and it works at
+ * full duty too, where the pin never goes low by itself.  The same
+ * kind of reading at every level, so one set of thresholds does.
+ * The overflow interrupt from tk-pwm.h is held off meanwhile, since
+ * it would write TCCR0A and put the pin back.
+ */
+uint8_t rest_tccr, rest_timsk;
+
+static inline void rest_begin() {
+    rest_timsk = TIMSK0;
+    TIMSK0 = 0;
+    rest_tccr = TCCR0A;
+    TCCR0A = rest_tccr & ~(1 << COM0B1);
+}
+
+static inline void rest_end() {
+    TCCR0A = rest_tccr;
+    TIMSK0 = rest_timsk;
+}
+
+#ifdef USE_ADC_SLEEP
+// ADC Noise Reduction mode, section 14.6 of the datasheet.
+// The CPU and clk_IO are halted while the ADC converts, which keeps
+// digital noise out of the reading, and we spend the time asleep.
+// Needs interrupts enabled, the ADC interrupt wakes us back up.
+// Timer 0 stops along with clk_IO, and the PWM pin stays as it was.
+EMPTY_INTERRUPT(ADC_vect);
+
+static uint8_t adc_convert() {
+    // Entering this sleep mode starts the conversion
+    ADCSRA |= (1 << ADIE);
+    set_sleep_mode(SLEEP_MODE_ADC);
+    do {
+        sleep_mode();
+    } while (ADCSRA & (1 << ADSC));  // something else woke us
+    // Send back the result
+    return ADCH;
+}
+#else
+static uint8_t adc_convert() {
     // Start conversion
     ADCSRA |= (1 << ADSC);
     // Wait for completion
@@ -57,6 +105,110 @@ uint8_t get_voltage() {
     // Send back the result
     return ADCH;
 }
+#endif  // USE_ADC_SLEEP
+
+// The resting voltage
+uint8_t get_voltage() {
+    uint8_t v;
+
+    rest_begin();
+    v = adc_convert();
+    rest_end();
+    return v;
+}
+
+#ifdef USE_VOLTAGE_FILTER
+// Oversampled, filtered voltage estimate.
+// Each call takes a burst of conversions and averages them, using all
+// 10 bits of the ADC.  The burst is then run through a median-of-3 with
+// the two previous bursts, so one noisy burst can't cause a step-down.
+// The result is 8.8 fixed point, on the same scale as ADCH and the
+// ADC_* values in tk-calibration.h (so ">> 8" gives the usual reading).
+#ifndef VOLTAGE_OVERSAMPLE
+#define VOLTAGE_OVERSAMPLE 2    // log2 of the burst length (4 conversions)
+#endif
+
+uint16_t voltage_hist[2];   // previous two bursts
+
+// The ADC is left-adjusted, so the 10 bit result sits in the top of
+// the register, and the sum of the scaled burst comes out as 8.8
+static uint16_t voltage_burst(uint8_t loaded) {
+    uint16_t a = 0;
+    uint8_t i;
+
+    for (i = 0; i < (1 << VOLTAGE_OVERSAMPLE); i++) {
+#ifdef USE_REST_VOLTAGE
+        // Just past BOTTOM the pin is high, in either PWM mode.
+        // In ADC sleep the timer (and so the pin) is frozen from
+        // here on, without it the sample is taken about 100 cycles
+        // later.  Either way at low duty this may be a resting
+        // reading, which is fine, there is little sag to see there.
+        if (loaded) {
+            while (TCNT0 >= 8) ;
+            adc_convert();
+        } else
+#else
+        (void) loaded;          // always a resting reading
+#endif
+            get_voltage();
+        a += ADC >> VOLTAGE_OVERSAMPLE;
+    }
+    return a;
+}
+
+// The resting voltage, filtered
+uint16_t get_filtered_voltage() {
+    uint16_t a, b, c, t;
+
+    a = voltage_burst(0);
+
+    // First time through, prime the history with this burst
+    if (! voltage_hist[0])
+        voltage_hist[0] = voltage_hist[1] = a;
+
+    b = voltage_hist[0];
+    c = voltage_hist[1];
+    voltage_hist[1] = b;
+    voltage_hist[0] = a;
+
+    // median of three
+    if (a > b) { t = a; a = b; b = t; }
+    if (b > c) b = (a > c) ? a : c;
+    return b;
+}
+
+#ifdef USE_REST_VOLTAGE
+// One burst with the LED on (not filtered, 8.8 like the above)
+#define get_loaded_voltage()    voltage_burst(1)
+#endif
+#endif  // USE_VOLTAGE_FILTER
+
+#ifdef USE_COMPENSATION
+// Duty gain (2.6 fixed point) for a loaded voltage (8.8 fixed point),
+// interpolated from the COMP_GAINS table in tk-calibration.h.
+PROGMEM const uint8_t comp_gains[] = { COMP_GAINS };
+
+#define COMP_SHIFT  (COMP_ADC_STEP == 1 ? 0 : COMP_ADC_STEP == 2 ? 1 : \
+                     COMP_ADC_STEP == 4 ? 2 : 3)
+
+uint8_t comp_gain(uint16_t voltage) {
+    uint16_t below;
+    uint8_t i, g0, g1;
+
+    if (voltage >= (COMP_ADC_TOP << 8))
+        return pgm_read_byte(comp_gains);
+
+    below = (COMP_ADC_TOP << 8) - voltage;
+    i = below >> (8 + COMP_SHIFT);
+    if (i >= sizeof(comp_gains) - 1)
+        return pgm_read_byte(comp_gains + sizeof(comp_gains) - 1);
+
+    g0 = pgm_read_byte(comp_gains + i);
+    g1 = pgm_read_byte(comp_gains + i + 1);
+    // how far between the two entries, out of 256
+    return g0 + (((g1 - g0) * (uint8_t)(below >> COMP_SHIFT)) >> 8);
+}
+#endif  // USE_COMPENSATION
 #else
 static inline void ADC_off() {
     ADCSRA &= ~(1<<7); //ADC off
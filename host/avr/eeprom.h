@@ -0,0 +1,21 @@
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+/*
+ * Host stand-in for <avr/eeprom.h>, see ../README.md
+ * The EEPROM is host_eeprom[] in hal-host.c, and an EEPROM
+ * "pointer" is just the address.
+ */
+
+#include <avr/io.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+uint16_t eeprom_read_word(const uint16_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t data);
+void eeprom_update_byte(uint8_t *addr, uint8_t data);
+
+#define eeprom_is_ready()   (! (EECR & (1 << EEPE)))
+#define eeprom_busy_wait()  do {} while (! eeprom_is_ready())
+
+#endif  // HOST_AVR_EEPROM_H
@@ -0,0 +1,27 @@
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+/*
+ * Host stand-in for <avr/interrupt.h>, see ../README.md
+ * An ISR is a plain function that hal-host.c calls when the
+ * hardware it models would have raised that interrupt.
+ */
+
+#include <avr/io.h>
+
+#define INT0_vect       host_isr_int0
+#define PCINT0_vect     host_isr_pcint0
+#define TIM0_OVF_vect   host_isr_tim0_ovf
+#define EE_RDY_vect     host_isr_ee_rdy
+#define ANA_COMP_vect   host_isr_ana_comp
+#define TIM0_COMPA_vect host_isr_tim0_compa
+#define TIM0_COMPB_vect host_isr_tim0_compb
+#define WDT_vect        host_isr_wdt
+#define ADC_vect        host_isr_adc
+
+#define ISR(vector)             void vector(void)
+#define EMPTY_INTERRUPT(vector) void vector(void) { }
+
+#define sei()   (SREG |= 0x80)
+#define cli()   (SREG &= ~0x80)
+
+#endif  // HOST_AVR_INTERRUPT_H
@@ -0,0 +1,140 @@
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+/*
+ * Host stand-in for <avr/io.h>, see ../README.md
+ *
+ * The ATtiny13A registers the firmware uses, as plain variables.
+ * The few with side effects (a conversion or EEPROM write to finish,
+ * the timer overflow interrupt, the count moving on, a flag to poll)
+ * go through a function that catches up with the hardware first, see
+ * hal-host.c.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+extern volatile uint8_t DDRB, PORTB, PINB;
+extern volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B;
+extern volatile uint8_t ADMUX, ADCH, DIDR0;
+extern volatile uint16_t ADC;
+extern volatile uint8_t MCUCR, EEARL, EEDR, SREG;
+extern volatile uint8_t OSCCAL, CLKPR, PRR, ACSR, BODCR;
+
+volatile uint8_t *host_timsk0(void);
+volatile uint8_t *host_tcnt0(void);
+volatile uint8_t *host_adcsra(void);
+volatile uint8_t *host_eecr(void);
+volatile uint8_t *host_tifr0(void);
+volatile uint8_t *host_wdtcr(void);
+
+#define TIMSK0  (*host_timsk0())
+#define TCNT0   (*host_tcnt0())
+#define ADCSRA  (*host_adcsra())
+#define EECR    (*host_eecr())
+#define TIFR0   (*host_tifr0())
+#define WDTCR   (*host_wdtcr())
+
+// Defined, as in the ATtiny13A's header (tk-power.h looks for them)
+#define PRR     PRR
+#define BODCR   BODCR
+
+#define PB0     0
+#define PB1     1
+#define PB2     2
+#define PB3     3
+#define PB4     4
+#define PB5     5
+
+// TCCR0A, TCCR0B
+#define COM0A1  7
+#define COM0A0  6
+#define COM0B1  5
+#define COM0B0  4
+#define WGM01   1
+#define WGM00   0
+#define WGM02   3
+#define CS02    2
+#define CS01    1
+#define CS00    0
+
+// TIMSK0, TIFR0
+#define OCIE0B  3
+#define OCIE0A  2
+#define TOIE0   1
+#define OCF0B   3
+#define OCF0A   2
+#define TOV0    1
+
+// ADMUX, ADCSRA, DIDR0
+#define REFS0   6
+#define ADLAR   5
+#define MUX1    1
+#define MUX0    0
+#define ADEN    7
+#define ADSC    6
+#define ADATE   5
+#define ADIF    4
+#define ADIE    3
+#define ADPS2   2
+#define ADPS1   1
+#define ADPS0   0
+#define ADC0D   5
+#define ADC2D   4
+#define ADC3D   3
+#define ADC1D   2
+#define AIN1D   1
+#define AIN0D   0
+
+// WDTCR
+#define WDTIF   7
+#define WDTIE   6
+#define WDP3    5
+#define WDCE    4
+#define WDE     3
+#define WDP2    2
+#define WDP1    1
+#define WDP0    0
+
+// MCUCR
+#define SE      5
+#define SM1     4
+#define SM0     3
+
+// BODCR (ATtiny13A only)
+#define BODS    1
+#define BODSE   0
+
+// EECR
+#define EEPM1   5
+#define EEPM0   4
+#define EERIE   3
+#define EEMPE   2
+#define EEPE    1
+#define EERE    0
+
+// CLKPR, PRR, ACSR
+#define CLKPCE  7
+#define PRTIM0  1
+#define PRADC   0
+#define ACD     7
+
+#define E2END   63
+#define RAMEND  0x9f
+
+#define _BV(b)  (1 << (b))
+
+#endif  // HOST_AVR_IO_H
@@ -0,0 +1,14 @@
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+/*
+ * Host stand-in for <avr/pgmspace.h>, see ../README.md
+ * There is only the one address space here.
+ */
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(p)    (*(const uint8_t *) (p))
+#define pgm_read_word(p)    (*(const uint16_t *) (p))
+
+#endif  // HOST_AVR_PGMSPACE_H
@@ -0,0 +1,25 @@
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+/*
+ * Host stand-in for <avr/sleep.h>, see ../README.md
+ * Sleeping is where simulated time goes by, see host_sleep().
+ */
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE         0
+#define SLEEP_MODE_ADC          (1 << SM0)
+#define SLEEP_MODE_PWR_DOWN     (1 << SM1)
+
+void host_sleep(void);
+
+#define set_sleep_mode(mode) \
+    (MCUCR = (MCUCR & ~((1 << SM1) | (1 << SM0))) | (mode))
+#define sleep_enable()      (MCUCR |= (1 << SE))
+#define sleep_disable()     (MCUCR &= ~(1 << SE))
+#define sleep_cpu()         host_sleep()
+#define sleep_mode()        host_sleep()
+#define sleep_bod_disable() \
+    (BODCR = (1 << BODS) | (1 << BODSE), BODCR = (1 << BODS))
+
+#endif  // HOST_AVR_SLEEP_H
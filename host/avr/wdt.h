@@ -0,0 +1,14 @@
+#ifndef HOST_AVR_WDT_H
+#define HOST_AVR_WDT_H
+/*
+ * Host stand-in for <avr/wdt.h>, see ../README.md
+ */
+
+#include <avr/io.h>
+
+void host_wdt_reset(void);
+
+#define wdt_reset()     host_wdt_reset()
+#define wdt_disable()   (WDTCR = 0)
+
+#endif  // HOST_AVR_WDT_H
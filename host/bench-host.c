@@ -0,0 +1,165 @@
+/*
+ * bench-host -- what the firmware costs in each of its modes, built
+ * for the host against hal-host.c (see README.md)
+ *
+ * usage: biscuit-bench [-f] | biscotti-bench [-f] | simple-bench [-f]
+ *
+ * One row for each level of biscuit, or each mode of the mode groups
+ * in biscotti and simple (a mode that already came up in an earlier
+ * group isn't run again).  Each gets a click from off, on a full
+ * cell, and runs for BENCH_SECS:
+ *
+ *   active     CPU cycles a second spent running, as the model sees
+ *              it: busy waits, EEPROM writes, polling the timer
+ *   sleep      CPU cycles a second asleep, in any sleep mode
+ *   adc        ms a second with the ADC enabled
+ *   duty       average PWM duty, in percent
+ *   first      cycles from power on until the LED came on
+ *
+ * The model gives the code between waits no time at all, so active
+ * is the waiting, which on these chips is nearly all of it.  The rows
+ * only depend on the firmware, so the output of two revisions can be
+ * diffed ("make bench-base" builds another one).  With -f, only
+ * "first", after the mode and a tab.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hal-host.h"
+
+#define BENCH_SECS  60.0
+
+static int first_only;          // -f
+
+// biscuit has levels
+extern uint8_t num_levels __attribute__ ((weak));
+// biscotti and simple have mode groups
+extern uint8_t modegroup __attribute__ ((weak));
+extern uint8_t solid_modes __attribute__ ((weak));
+extern const uint8_t modegroups[] __attribute__ ((weak));
+
+#define OPT_modegroup   (HOST_EEPSIZE-1)
+
+static const struct {
+    uint8_t mode;
+    const char *name;
+} names[] = {
+    { 254, "battcheck" },
+    { 253, "group select" },
+    { 252, "osccal" },
+    { 251, "strobe" },
+    { 250, "biking strobe" },
+    { 248, "police strobe" },
+    { 247, "random strobe" },
+    { 246, "SOS" },
+    { 245, "beacon" },
+};
+
+static void
+header(void)
+{
+    if (first_only)
+        return;
+    printf("%-20s %9s %9s %7s %7s %9s\n",
+           "mode", "active/s", "sleep/s", "adc ms", "duty %", "first");
+}
+
+/* Mode "i" (counting from 0) is a long press, then i short presses.
+ * The last click is the one that counts, from off to BENCH_SECS on.
+ */
+static void
+bench_mode(const char *name, int i)
+{
+    int j;
+
+    if (i) {
+        host_run(10.0, 1.0);
+        for (j = 1; j < i; j++)
+            host_run(0.1, 1.0);
+    }
+    host_cell.used_mah = 0;
+    memset(&host_stats, 0, sizeof host_stats);
+    host_run(i ? 0.1 : 10.0, BENCH_SECS);
+
+    if (first_only) {
+        printf("%s\t%.0f\n", name, host_first_light);
+        return;
+    }
+    printf("%-20s %9.0f %9.0f %7.1f %7.3f %9.0f\n", name,
+           host_stats.active / BENCH_SECS, host_stats.sleep / BENCH_SECS,
+           host_stats.adc_on * 1000.0 / BENCH_SECS,
+           host_stats.light * 100.0 / BENCH_SECS, host_first_light);
+}
+
+static void
+bench_levels(void)
+{
+    char name[32];
+    int i;
+
+    host_run(10.0, 1.0);
+    for (i = 1; i < num_levels; i++) {
+        snprintf(name, sizeof name, "level %d", i);
+        bench_mode(name, i - 1);
+    }
+}
+
+static void
+bench_groups(void)
+{
+    uint8_t seen[256];
+    char name[32];
+    int g, i, j, n, mode;
+
+    memset(seen, 0, sizeof seen);
+    host_run(10.0, 1.0);            // first boot, saves the defaults
+    for (g = 0; g < 256; g++) {
+        host_eeprom[OPT_modegroup] = g;
+        host_run(10.0, 1.0);
+        if (modegroup != g)         // no such group, back to group 0
+            break;
+        n = solid_modes;
+        for (i = 0; i < n; i++) {
+            mode = modegroups[(g << 3) + i];
+            if (seen[mode])
+                continue;
+            seen[mode] = 1;
+
+            snprintf(name, sizeof name, "level %d", mode);
+            for (j = 0; j < sizeof names / sizeof names[0]; j++)
+                if (names[j].mode == mode)
+                    snprintf(name, sizeof name, "%s", names[j].name);
+            bench_mode(name, i);
+        }
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    first_only = argc > 1 && ! strcmp(argv[1], "-f");
+    header();
+    if (&num_levels)
+        bench_levels();
+    else
+        bench_groups();
+    return 0;
+}
+
+/* THE END */
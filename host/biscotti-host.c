@@ -0,0 +1,571 @@
+/*
+ * biscotti-host -- checks for biscotti, built for the host against
+ * hal-host.c (see README.md)
+ *
+ * usage: biscotti-host           run the checks
+ *        biscotti-host -e FILE   the same, and with USE_STATS write
+ *                                the EEPROM to FILE, as avrdude's :r
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "hal-host.h"
+
+// From biscotti.c
+extern uint8_t mode_idx;
+extern uint8_t solid_modes;
+extern uint8_t modegroup;
+extern const uint8_t modegroups[];
+#define BIKING_STROBE   250
+// Only there with USE_STATS
+extern void stat_add(uint8_t addr) __attribute__ ((weak));
+
+// From tk-stats.h
+#define STAT_BASE       (HOST_EEPSIZE/2)
+#define STAT_LEVELS     8
+#define STAT_boots_ones (STAT_BASE)
+#define STAT_boots      (STAT_BASE+1)
+#define STAT_minutes    (STAT_BASE+3)
+#define STAT_stepdowns  (STAT_minutes + 2*STAT_LEVELS)
+#define STAT_shutdowns  (STAT_stepdowns+2)
+#define STAT_minvolt    (STAT_shutdowns+2)
+
+#define OPT_modegroup   (HOST_EEPSIZE-1)
+#define OPT_memory      (HOST_EEPSIZE-2)
+#define OPT_mode_override (HOST_EEPSIZE-3)
+#define OPT_osccal      (HOST_EEPSIZE-6)
+
+static int failed;
+static int checks;
+
+#define check(cond, ...) \
+    do { \
+        checks++; \
+        if (! (cond)) { \
+            failed++; \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+static void
+fresh_cell(void)
+{
+    host_cell.used_mah = 0;
+}
+
+// Take enough out of the cell to bring it to "v" at rest
+static void
+rest_volts(double v)
+{
+    double lo = 0, hi = host_cell.capacity_mah;
+    int n;
+
+    for (n = 0; n < 40; n++) {
+        host_cell.used_mah = (lo + hi) / 2;
+        if (host_rest_volts() > v)
+            lo = host_cell.used_mah;
+        else
+            hi = host_cell.used_mah;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+/* A long press starts at the first mode, each short press goes to
+ * the next, and the last wraps around to the first again.
+ * The first five of group 0 are solid, and get brighter.
+ */
+static void
+check_clicks(void)
+{
+    double duty[5];
+    int i, n;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);
+    n = solid_modes;
+    duty[0] = host_duty();
+    check(mode_idx == 0, "long press gave mode %d", mode_idx);
+    check(duty[0] > 0, "light is off in mode 0");
+
+    for (i = 1; i < n; i++) {
+        host_run(0.1, 1.0);
+        check(mode_idx == i, "short press %d gave mode %d", i, mode_idx);
+        if (i < 5) {
+            duty[i] = host_duty();
+            check(duty[i] > duty[i-1], "mode %d duty %.4f not above %.4f",
+                  i, duty[i], duty[i-1]);
+        }
+    }
+    host_run(0.1, 1.0);
+    check(mode_idx == 0, "mode %d didn't wrap around", n-1);
+
+    host_run(0.1, 1.0);
+    host_run(5.0, 1.0);
+    check(mode_idx == 0, "long press from mode 1 gave mode %d", mode_idx);
+}
+
+/* Solid modes light up before saving the mode or anything else
+ * that waits (the baseline firmware saved first, 33472 cycles)
+ */
+static void
+check_first_light(void)
+{
+    int i;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);            // first boot, saves the defaults
+    host_run(10.0, 1.0);
+    for (i = 0; i < 5; i++) {
+        check(host_first_light == 0, "light on %.0f cycles into mode %d",
+              host_first_light, mode_idx);
+        host_run(0.1, 1.0);
+    }
+}
+
+/* Cut the power at random times in the first few ms, which is when
+ * the mode gets saved, then see what the next short press goes to.
+ * The save either went through or it didn't, so that is one or two
+ * modes on from where we were.  Enough of them go round the ring of
+ * saved modes many times, through the cuts between the write and
+ * the erase half way round, and through the middle of each, which
+ * leaves the cell with only some of its bits done.
+ * In group 1, which is all solid modes: the blinky ones take more
+ * than a pass through the main loop to clear fast_presses.
+ */
+static void
+check_save_cut(void)
+{
+    int i, n, cur, a, b;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_eeprom[0] = 0xf0;                  // mode 0 saved
+    host_eeprom[HOST_EEPSIZE-1] = 1;        // OPT_modegroup
+    host_eeprom[HOST_EEPSIZE-2] = 0;        // OPT_memory
+    host_eeprom[HOST_EEPSIZE-3] = 0;        // OPT_mode_override
+    host_eeprom_tear = 1;
+    host_run(10.0, 1.0);
+    n = solid_modes;
+    cur = mode_idx;
+
+    for (i = 0; i < 2000; i++) {
+        host_run(0.1, (rand() % 12000) / 1e6);
+        host_run(0.1, 0.6);
+        a = (cur + 1) % n;
+        b = (cur + 2) % n;
+        check(mode_idx == a || mode_idx == b,
+              "cut from mode %d, then came back on in mode %d", cur, mode_idx);
+        cur = mode_idx;
+        if (host_cell.used_mah > host_cell.capacity_mah / 2)
+            fresh_cell();
+    }
+    host_eeprom_tear = 0;
+}
+
+/* A newest cell that was cut part way through its write reads back
+ * as the save before, and is erased.  A cell of some other firmware
+ * (plain mode numbers) is a first boot.
+ */
+static void
+check_save_torn(void)
+{
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_eeprom[0] = 0xf0;                  // mode 0
+    host_eeprom[1] = 0xe1;                  // mode 1
+    host_eeprom[2] = 0xfd;                  // mode 2 (0xd2), cut short
+    host_eeprom[HOST_EEPSIZE-1] = 1;        // OPT_modegroup
+    host_eeprom[HOST_EEPSIZE-2] = 1;        // OPT_memory
+    host_eeprom[HOST_EEPSIZE-3] = 0;        // OPT_mode_override
+    host_run(10.0, 1.0);
+    check(mode_idx == 1, "torn save of mode 2 came back as mode %d", mode_idx);
+    check(host_eeprom[2] == 0xe1, "cell 2 holds %#x, not mode 1 again",
+          host_eeprom[2]);
+
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_eeprom[7] = 3;
+    host_eeprom[8] = 4;
+    host_eeprom[HOST_EEPSIZE-1] = 1;
+    host_run(10.0, 1.0);
+    check(modegroup == 0, "old cells gave mode group %d", modegroup);
+    check(host_eeprom[7] == 0xff && host_eeprom[8] == 0xff,
+          "old cells left behind: %#x %#x", host_eeprom[7], host_eeprom[8]);
+}
+
+/* The biking strobe, a flash at full for 8 "4 ms" steps, then 250
+ * at level 3, from the table that play() runs through.  With
+ * USE_TIMER_DELAY a step is 4 ms off timer 0 and the CPU idles
+ * through nearly all of it; otherwise it is BOGOMIPS*4 delay loops,
+ * 3.2 ms of busy waiting.  Every flash and every dim stretch has to
+ * be as long as its steps, give or take a compare match, and the
+ * voltage reading the main loop waits for (13 ADC clocks, 173 us)
+ * at the end of each pass.
+ */
+#ifdef USE_TIMER_DELAY
+#define STEP_SECS       0.004
+#else
+#define STEP_SECS       (4 * 4 * 950 / HOST_F_CPU)    // BOGOMIPS, tk-attiny.h
+#endif
+#define STROBE_MODE     6           // BIKING_STROBE in group 0
+#define STROBE_FLASH    8
+#define STROBE_DIM      250
+#define STROBE_SECS     20.0
+#define STROBE_SLACK    0.00025
+
+static double strobe_t;             // when the light last changed
+static int strobe_full;
+static int strobe_edges, strobe_bad, strobe_flashes;
+
+static void
+strobe_light(double t, double duty)
+{
+    int steps = strobe_full ? STROBE_FLASH : STROBE_DIM;
+    double off = t - strobe_t - steps * STEP_SECS;
+
+    if (strobe_full == (duty == 1.0))
+        return;
+    if (strobe_edges++ > 1) {       // the first flash may be cut short
+        if (off > STROBE_SLACK || off < -STROBE_SLACK) {
+            if (strobe_bad++ < 5)
+                printf("%s of %.2f steps, not %d\n",
+                       strobe_full ? "flash" : "dim stretch",
+                       (t - strobe_t) / STEP_SECS, steps);
+        } else if (strobe_full) {
+            strobe_flashes++;
+        }
+    }
+    strobe_t = t;
+    strobe_full = duty == 1.0;
+}
+
+static void
+check_strobe(void)
+{
+    double busy;
+    int i, mode;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_eeprom[0] = 0xf0;                  // mode 0
+    host_eeprom[HOST_EEPSIZE-1] = 0;        // OPT_modegroup
+    host_eeprom[HOST_EEPSIZE-2] = 0;        // OPT_memory
+    host_eeprom[HOST_EEPSIZE-3] = 0;        // OPT_mode_override
+    host_run(10.0, 1.0);
+    for (i = 1; i < STROBE_MODE; i++)
+        host_run(0.1, 1.0);
+    memset(&host_stats, 0, sizeof host_stats);
+    strobe_full = strobe_edges = 0;
+    host_light_hook = strobe_light;
+    host_run(0.1, STROBE_SECS);
+    host_light_hook = NULL;
+    mode = modegroups[(modegroup << 3) + mode_idx];
+    busy = host_stats.active / (host_stats.active + host_stats.sleep);
+
+    check(mode == BIKING_STROBE, "in mode %d, not the biking strobe", mode);
+    check(strobe_bad == 0, "%d flashes or dim stretches off by more than "
+          "%.0f us", strobe_bad, STROBE_SLACK * 1e6);
+    check(strobe_flashes >= STROBE_SECS /
+          ((STROBE_FLASH + STROBE_DIM) * STEP_SECS) - 2,
+          "%d flashes in %.0f s", strobe_flashes, STROBE_SECS);
+#ifdef USE_TIMER_DELAY
+    check(busy < 0.01, "busy %.1f%% of the time in the strobe", busy * 100);
+#endif
+    printf("strobe: %d flashes in %.0f s, %.2f ms steps, "
+           "busy %.1f%% of the time\n", strobe_flashes, STROBE_SECS,
+           STEP_SECS * 1000, busy * 100);
+    fresh_cell();
+}
+
+#ifdef BEACON
+/* BEACON, after BATTCHECK in group 4: the watchdog wakes the chip
+ * every 2 seconds (2.048 in the model) for a flash at full of
+ * BEACON_ON (10) steps.  In between it is powered down, which the
+ * model counts as sleep, with the ADC off.
+ */
+#define BEACON_MODE     6
+#define BEACON_GROUP    3
+#define BEACON_SECS     60.0
+#define BEACON_FLASH    10
+
+static double beacon_t;             // when the last flash started
+static int beacon_full;
+static int beacon_flashes, beacon_bad;
+
+static void
+beacon_light(double t, double duty)
+{
+    double len = (t - beacon_t) / STEP_SECS;
+
+    if (beacon_full == (duty == 1.0))
+        return;
+    beacon_full = duty == 1.0;
+    if (! beacon_full) {
+        if (len < BEACON_FLASH - 0.1 || len > BEACON_FLASH + 0.1) {
+            if (beacon_bad++ < 5)
+                printf("beacon flash of %.2f steps\n", len);
+        }
+        beacon_flashes++;
+        return;
+    }
+    if (beacon_flashes && (t - beacon_t < 2.048 || t - beacon_t > 2.1)) {
+        if (beacon_bad++ < 5)
+            printf("beacon flashes %.3f s apart\n", t - beacon_t);
+    }
+    beacon_t = t;
+}
+
+static void
+check_beacon(void)
+{
+    double busy;
+    int i, mode;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_eeprom[0] = 0xf0;                  // mode 0
+    host_eeprom[HOST_EEPSIZE-1] = BEACON_GROUP;
+    host_eeprom[HOST_EEPSIZE-2] = 0;        // OPT_memory
+    host_eeprom[HOST_EEPSIZE-3] = 0;        // OPT_mode_override
+    host_run(10.0, 1.0);
+    for (i = 1; i < BEACON_MODE; i++)
+        host_run(0.1, 1.0);
+    memset(&host_stats, 0, sizeof host_stats);
+    beacon_full = beacon_flashes = beacon_bad = 0;
+    host_light_hook = beacon_light;
+    host_run(0.1, BEACON_SECS);
+    host_light_hook = NULL;
+    mode = modegroups[(modegroup << 3) + mode_idx];
+    busy = host_stats.active / (host_stats.active + host_stats.sleep);
+
+    check(mode == BEACON, "in mode %d, not the beacon", mode);
+    check(beacon_bad == 0, "%d beacon flashes too long, short or far apart",
+          beacon_bad);
+    check(beacon_flashes >= BEACON_SECS / 2.1 - 1, "%d flashes in %.0f s",
+          beacon_flashes, BEACON_SECS);
+    check(busy < 0.05, "awake %.1f%% of the time", busy * 100);
+    check(host_stats.adc_on < 0.05 * BEACON_SECS,
+          "ADC on for %.1f s of %.0f", host_stats.adc_on, BEACON_SECS);
+    printf("beacon: %d flashes in %.0f s, awake %.1f%% of the time, "
+           "ADC on %.2f%%\n", beacon_flashes, BEACON_SECS, busy * 100,
+           host_stats.adc_on * 100 / BEACON_SECS);
+    fresh_cell();
+}
+#endif
+
+#ifdef OSCCAL_MODE
+/* OSCCAL_MODE, on a chip whose oscillator runs 8% fast: config mode
+ * (more than 9 clicks), and a click off during the buzz of option 3.
+ * One run through config mode uncut finds when that buzz starts (the
+ * 71st flash: one, the buzz of 32, two, the buzz, three), the next
+ * cuts it there.  The power on after that trims the oscillator in
+ * the dark, to within a step of OSCCAL, and stores it; the one after
+ * that puts it back.
+ */
+#define CAL_RC          1.08
+#define CAL_CLICKS      11
+#define CAL_FLASH       71
+
+static double cal_flash[CAL_FLASH];
+static int cal_flashes, cal_lit;
+
+static void
+cal_light(double t, double duty)
+{
+    if (duty > 0 && ! cal_lit && cal_flashes < CAL_FLASH)
+        cal_flash[cal_flashes++] = t;
+    cal_lit = duty > 0;
+}
+
+static void
+cal_clicks(void)
+{
+    int i;
+
+    for (i = 0; i < CAL_CLICKS; i++)
+        host_run(0.1, 0.1);
+}
+
+static void
+check_osccal(void)
+{
+    double t0, cut, mhz;
+    uint8_t factory = OSCCAL;
+
+    fresh_cell();
+    host_rc = CAL_RC;
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);                    // first boot, saves the defaults
+    host_eeprom[OPT_modegroup] = 1;         // all solid, see check_save_cut
+    host_run(10.0, 1.0);
+
+    cal_clicks();
+    cal_flashes = cal_lit = 0;
+    host_light_hook = cal_light;
+    t0 = host_time + 0.1;
+    host_run(0.1, 20.0);
+    host_light_hook = NULL;
+    check(cal_flashes == CAL_FLASH, "%d flashes in config mode", cal_flashes);
+    cut = cal_flash[CAL_FLASH - 1] - t0 + 0.2;
+
+    host_run(10.0, 1.0);
+    cal_clicks();
+    host_run(0.1, cut);
+    check(host_eeprom[OPT_mode_override] == 1, "option 3 not saved");
+
+    host_run(0.1, 5.0);
+    mhz = host_cpu_hz() / 1e6;
+    check(host_eeprom[OPT_osccal] == OSCCAL, "OSCCAL %#x, stored %#x",
+          OSCCAL, host_eeprom[OPT_osccal]);
+    check(mhz > 4.8 * (1 - HOST_OSCCAL_STEP) && mhz < 4.8 * (1 + HOST_OSCCAL_STEP),
+          "trimmed to %.3f MHz", mhz);
+    check(host_first_light > 0.5 * host_cpu_hz(),
+          "light on %.0f cycles after power on, while trimming",
+          host_first_light);
+    printf("osccal: %#x at %.2f MHz, trimmed to %#x at %.3f MHz, "
+           "dark for %.0f ms\n", factory, CAL_RC * 4.8, OSCCAL, mhz,
+           host_first_light * 1000 / host_cpu_hz());
+
+    host_run(10.0, 1.0);
+    check(OSCCAL == host_eeprom[OPT_osccal] && host_cpu_hz() / 1e6 == mhz,
+          "OSCCAL %#x at the next power on, stored %#x", OSCCAL,
+          host_eeprom[OPT_osccal]);
+    check(host_first_light < 0.01 * host_cpu_hz(),
+          "trimmed again, light on after %.0f cycles", host_first_light);
+
+    host_rc = 1.0;
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);
+    fresh_cell();
+}
+#endif
+
+/* USE_STATS: a first boot and some clicks in group 1 (all solid),
+ * a few minutes in one mode, then a cell that runs out, which LVP
+ * steps down and shuts off.  Every click is a boot, the minutes go
+ * to the level of that mode, and the low cell shows in the step
+ * downs, the shutdown and the lowest voltage.
+ */
+#define STATS_CLICKS    20
+#define STATS_MINUTES   5
+
+// Stored counter to count, as in tk-stats.h and bin/stats_decode.py
+static int
+stat_count(int addr)
+{
+    unsigned v = host_eeprom[addr] | (host_eeprom[addr + 1] << 8);
+
+    if (! (v & 0x100))
+        v ^= 0xff;
+    return ~v & 0xffff;
+}
+
+static void
+check_stats(const char *dump)
+{
+    int i, level, boots, why;
+    uint8_t full_volts;
+    FILE *f;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);            // first boot, saves the defaults
+    host_eeprom[OPT_modegroup] = 1;
+    host_run(10.0, 1.0);
+    for (i = 0; i < STATS_CLICKS; i++)
+        host_run(0.1, 1.0);
+    host_run(0.1, STATS_MINUTES * 60 + 10.0);
+    level = modegroups[(modegroup << 3) + mode_idx];
+    full_volts = host_eeprom[STAT_minvolt];
+
+    for (i = 0; i < STAT_LEVELS; i++)
+        check(stat_count(STAT_minutes + 2 * i) ==
+              (i == level - 1 ? STATS_MINUTES : 0),
+              "%d minutes at level %d, %d minutes on at level %d",
+              stat_count(STAT_minutes + 2 * i), i + 1, STATS_MINUTES, level);
+    check(full_volts != 0xff, "no voltage reading saved");
+
+    rest_volts(2.9);
+    why = host_run(0.1, 60.0);
+    boots = stat_count(STAT_boots) * 8 +
+        __builtin_popcount(~host_eeprom[STAT_boots_ones] & 0xff);
+
+    check(why == HOST_OFF, "a flat cell didn't shut the light off");
+    check(boots == STATS_CLICKS + 4, "%d boots counted, %d clicks",
+          boots, STATS_CLICKS + 4);
+    check(stat_count(STAT_stepdowns) >= 1, "no step downs counted");
+    check(stat_count(STAT_shutdowns) == 1, "%d shutdowns counted",
+          stat_count(STAT_shutdowns));
+    check(host_eeprom[STAT_minvolt] < full_volts,
+          "lowest voltage %d, %d on a full cell",
+          host_eeprom[STAT_minvolt], full_volts);
+    printf("stats: %d boots, %d minutes at level %d, %d step downs, "
+           "%d shutdown, lowest ADC %d\n", boots,
+           stat_count(STAT_minutes + 2 * (level - 1)), level,
+           stat_count(STAT_stepdowns), stat_count(STAT_shutdowns),
+           host_eeprom[STAT_minvolt]);
+
+    if (dump) {
+        f = fopen(dump, "wb");
+        check(f && fwrite(host_eeprom, 1, HOST_EEPSIZE, f) == HOST_EEPSIZE,
+              "can't write %s", dump);
+        if (f)
+            fclose(f);
+    }
+    fresh_cell();
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *dump = NULL;
+
+    if (argc == 3 && strcmp(argv[1], "-e") == 0)
+        dump = argv[2];
+    else if (argc != 1) {
+        fprintf(stderr, "usage: biscotti-host [-e dump]\n");
+        return 1;
+    }
+
+    check_clicks();
+    check_first_light();
+    check_save_cut();
+    check_save_torn();
+    check_strobe();
+#ifdef BEACON
+    check_beacon();
+#endif
+#ifdef OSCCAL_MODE
+    check_osccal();
+#endif
+    if (stat_add)
+        check_stats(dump);
+
+    printf("%d checks, %d failed\n", checks, failed);
+    return failed ? 1 : 0;
+}
+
+/* THE END */
@@ -0,0 +1,764 @@
+/*
+ * biscuit-host -- checks and a benchmark for biscuit, built for the
+ * host against hal-host.c (see README.md)
+ *
+ * usage: biscuit-host            run the checks
+ *        biscuit-host -t FILE    the same, and with USE_TELEMETRY
+ *                                write what the pin sent to FILE
+ *        biscuit-host -b N       time N random clicks
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <avr/io.h>
+
+#include "hal-host.h"
+
+// From biscuit.c
+extern uint8_t level_idx;
+extern uint8_t num_levels;
+// Only there with USE_COULOMB
+extern uint16_t coul_used __attribute__ ((weak));
+// Only there with USE_COMPENSATION, 64 is a gain of 1
+extern uint8_t duty_gain __attribute__ ((weak));
+// Only there with USE_REST_VOLTAGE
+extern uint16_t sag_full __attribute__ ((weak));
+// Only there with USE_TELEMETRY
+extern uint8_t telem_tick __attribute__ ((weak));
+extern volatile uint8_t telem_left __attribute__ ((weak));
+extern volatile uint8_t telem_bits __attribute__ ((weak));
+#define TELEM_PIN   PB3
+#define TELEM_LEN   7
+// Only there with USE_PWM_DITHER
+extern volatile uint8_t pwm_frac __attribute__ ((weak));
+#define COUL_MAH    4
+
+static int failed;
+static int checks;
+
+// The duty at each level, from check_clicks()
+static double level_duty[32];
+
+#define check(cond, ...) \
+    do { \
+        checks++; \
+        if (! (cond)) { \
+            failed++; \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+static void
+fresh_cell(void)
+{
+    host_cell.used_mah = 0;
+}
+
+/* The duty at each watchdog tick, for the checks that
+ * want to see what the light did over time.
+ */
+#define TRACE_MAX   200000
+static double trace[TRACE_MAX];
+static int ntrace;
+static double adc_lo, adc_hi;   // range of the ADC clock, too
+
+static void
+trace_tick(void)
+{
+    if (ntrace < TRACE_MAX)
+        trace[ntrace++] = host_duty();
+    if (host_adc_hz < adc_lo)
+        adc_lo = host_adc_hz;
+    if (host_adc_hz > adc_hi)
+        adc_hi = host_adc_hz;
+}
+
+/* A long press, then short presses up to "level",
+ * which stays on for "on" seconds
+ */
+static int
+click_to(int level, double on)
+{
+    int i;
+
+    if (level == 1)
+        return host_run(10.0, on);
+    host_run(10.0, 1.0);
+    for (i = 2; i < level; i++)
+        host_run(0.1, 1.0);
+    return host_run(0.1, on);
+}
+
+/* ---------------------------------------------------------------- */
+
+/* A long press starts at the bottom, each short press goes up one,
+ * and the top wraps around to the bottom again.
+ */
+static void
+check_clicks(void)
+{
+    double duty[32];
+    int i, n = num_levels - 1;
+
+    fresh_cell();
+    host_run(10.0, 1.0);
+    duty[0] = host_duty();
+    check(level_idx == 1, "long press gave level %d", level_idx);
+    check(duty[0] > 0, "light is off at level 1");
+
+    for (i = 1; i <= n; i++) {
+        host_run(0.1, 1.0);
+        duty[i] = host_duty();
+    }
+    memcpy(level_duty + 1, duty, n * sizeof duty[0]);
+    for (i = 1; i < n; i++)
+        check(duty[i] > duty[i-1], "level %d duty %.4f not above %.4f",
+              i+1, duty[i], duty[i-1]);
+    check(duty[n] == duty[0], "level %d didn't wrap around", n+1);
+    check(level_idx == 1, "wrapped to level %d", level_idx);
+
+    host_run(0.1, 1.0);
+    host_run(5.0, 1.0);
+    check(level_idx == 1, "long press from level 2 gave level %d", level_idx);
+}
+
+/* The light must come on before the first watchdog tick, and
+ * before anything waits (the baseline firmware started the ADC
+ * first, 832 cycles).  A dithered moon only lights the periods
+ * where the fraction carries, which takes a few of them.
+ */
+static void
+check_first_light(void)
+{
+    int i;
+
+    fresh_cell();
+    for (i = 0; i < 20; i++) {
+        host_run(i & 1 ? 0.1 : 3.0, 0.01);
+        check(host_duty() > 0, "still dark 10 ms after click %d", i);
+        check(host_first_light == 0 ||
+              (&pwm_frac && host_first_light > 0 && host_first_light < 4096),
+              "light on %.0f cycles after click %d", host_first_light, i);
+    }
+}
+
+/* Run at the top level until the light turns itself off,
+ * on a cell (and spring and wiring) of "ohms"
+ */
+static void
+check_discharge(double ohms)
+{
+    int why, i, steps = 0, ups = 0;
+    double top, start;
+
+    fresh_cell();
+    host_cell.ohms = ohms;
+    click_to(num_levels - 1, 1.0);
+    top = host_duty();
+
+    // Up to the top again, trace only the last click
+    click_to(num_levels - 2, 1.0);
+    start = host_time;
+    ntrace = 0;
+    adc_lo = adc_hi = host_adc_hz;
+    host_tick_hook = trace_tick;
+    why = host_run(0.1, 24 * 3600.0);
+    host_tick_hook = NULL;
+
+    check(why == HOST_OFF, "still on after a day");
+    check(host_rest_volts() > 2.9, "ran the cell down to %.2f V",
+          host_rest_volts());
+    check(host_cell.used_mah > 0.9 * host_cell.capacity_mah,
+          "shut off with %.0f of %.0f mAh used",
+          host_cell.used_mah, host_cell.capacity_mah);
+
+    for (i = 1; i < ntrace; i++) {
+        if (trace[i] < trace[i-1] * 0.9)
+            steps++;
+        if (trace[i] > trace[i-1] * 1.1)
+            ups++;
+        // Only moon may go dark, the rest step down a level
+        check(trace[i] > 0 || trace[i-1] < level_duty[2],
+              "tick %d went dark from duty %.3f", i, trace[i-1]);
+        check(trace[i] <= top, "tick %d duty %.3f above %.3f",
+              i, trace[i], top);
+    }
+    check(steps >= num_levels - 2, "only %d step downs", steps);
+    // The cell only runs down, nothing should bring it back up
+    check(ups == 0, "stepped back up %d times", ups);
+    // The step downs change the clock (tk-clock.h), with the ADC stopped
+    check(adc_lo >= 50e3 && adc_hi <= 200e3,
+          "ADC clock from %.1f to %.1f kHz", adc_lo / 1e3, adc_hi / 1e3);
+
+    printf("discharge: %.2f ohms, %.2f h at the top level, %d step downs, "
+           "%d back up, %.0f mAh used, %.2f V at rest\n",
+           ohms, (host_time - start) / 3600.0, steps, ups,
+           host_cell.used_mah, host_rest_volts());
+    host_cell.ohms = HOST_CELL_OHMS;
+}
+
+/* A cell that comes back up after LVP stepped down (a cold one that
+ * warms up, say).  The resting voltage follows a script, tick by
+ * tick: low enough for a few step downs, then up above ADC_RECOVER
+ * (3.3 V), with a dip below it, but not as low as ADC_LOW, part way.
+ * Each tick's reading goes through the median of three, so the dip
+ * lasts three ticks, and a reading is seen a tick late.
+ * LVP must step back up one level at a time, each after RECOVER_CNT
+ * ticks above ADC_RECOVER (plus the LVP_WAIT ticks after the last
+ * change, which don't count), start counting over after the dip,
+ * and never go above the level that was clicked.
+ */
+#define RECOVER_CNT     40
+#define LVP_WAIT        4
+#define REC_TICKS       400
+#define REC_LOW         14      // ticks low, for a few step downs
+#define REC_DIP         45      // three ticks just under ADC_RECOVER
+
+static int rec_ticks;
+static int rec_level[REC_TICKS];
+
+static void
+rest_volts(double v)
+{
+    double lo = 0, hi = host_cell.capacity_mah;
+    int n;
+
+    for (n = 0; n < 40; n++) {
+        host_cell.used_mah = (lo + hi) / 2;
+        if (host_rest_volts() > v)
+            lo = host_cell.used_mah;
+        else
+            hi = host_cell.used_mah;
+    }
+}
+
+// How many times one duty is the other
+static double
+apart(double a, double b)
+{
+    return a > b ? a / b : b / a;
+}
+
+static void
+recover_tick(void)
+{
+    double duty = host_duty();
+    int i, near = 1;
+
+    if (rec_ticks >= REC_TICKS)
+        return;
+    // The level with the nearest duty, they are about twice apart
+    if (&duty_gain)
+        duty = duty * 64 / duty_gain;
+    for (i = 2; i < num_levels; i++)
+        if (apart(duty, level_duty[i]) < apart(duty, level_duty[near]))
+            near = i;
+    rec_level[rec_ticks] = near;
+    check(level_idx == num_levels - 2, "level_idx went to %d", level_idx);
+
+    if (rec_ticks < REC_LOW)
+        rest_volts(2.9);
+    else if (rec_ticks >= REC_DIP && rec_ticks < REC_DIP + 3)
+        rest_volts(3.15);
+    else
+        rest_volts(3.7);
+    rec_ticks++;
+}
+
+static void
+check_recover(void)
+{
+    int i, downs = 0, ups = 0, low, last = -1;
+
+    fresh_cell();
+    click_to(num_levels - 3, 1.0);
+    rec_ticks = 0;
+    host_tick_hook = recover_tick;
+    host_run(0.1, REC_TICKS * 0.3);    // a tick is 0.256 s
+    host_tick_hook = NULL;
+    check(rec_ticks == REC_TICKS, "only ran %d ticks", rec_ticks);
+
+    low = rec_level[0];
+    for (i = 1; i < REC_TICKS; i++) {
+        if (rec_level[i] < rec_level[i-1]) {
+            downs++;
+            check(i <= REC_LOW + 1, "stepped down at tick %d", i);
+            low = rec_level[i];
+        }
+        if (rec_level[i] > rec_level[i-1]) {
+            check(rec_level[i] == rec_level[i-1] + 1,
+                  "tick %d went up from level %d to %d",
+                  i, rec_level[i-1], rec_level[i]);
+            if (! ups)
+                // the count starts over on the dip's last reading
+                check(i >= REC_DIP + 3 + RECOVER_CNT &&
+                      i <= REC_DIP + 3 + RECOVER_CNT + 2,
+                      "first step up at tick %d, dip ended at %d",
+                      i, REC_DIP + 3);
+            else
+                check(i - last == LVP_WAIT + RECOVER_CNT,
+                      "step up at tick %d, %d after the last", i, i - last);
+            ups++;
+            last = i;
+        }
+        check(rec_level[i] <= level_idx, "tick %d at level %d, above %d",
+              i, rec_level[i], level_idx);
+    }
+    check(downs >= 2, "only %d step downs", downs);
+    check(ups == downs, "%d step downs, %d back up", downs, ups);
+    check(rec_level[REC_TICKS-1] == level_idx, "ended at level %d of %d",
+          rec_level[REC_TICKS-1], level_idx);
+
+    printf("recover: down to level %d, back up to %d in %d steps, "
+           "%d ticks apart\n", low, rec_level[REC_TICKS-1], ups,
+           LVP_WAIT + RECOVER_CNT);
+    fresh_cell();
+}
+
+/* While on, no pin floats and the ADC is only on for the readings.
+ * After LVP shuts off, next to nothing is left drawing, even with
+ * the BOD fused on.
+ */
+static int adc_ticks;
+
+static void
+adc_tick(void)
+{
+    if (ADCSRA & (1 << ADEN))
+        adc_ticks++;
+}
+
+static void
+check_power(void)
+{
+    int why;
+
+    fresh_cell();
+    host_run(10.0, 1.0);
+    check(host_floating() == 0, "pins 0x%02x floating", host_floating());
+    check(ACSR & (1 << ACD), "analog comparator on");
+
+    adc_ticks = 0;
+    host_tick_hook = adc_tick;
+    host_run(10.0, 60.0);
+    host_tick_hook = NULL;
+    check(adc_ticks == 0, "ADC on between readings at %d ticks", adc_ticks);
+
+    host_bod_fuse = 1;
+    why = click_to(num_levels - 1, 24 * 3600.0);
+    check(why == HOST_OFF, "still on after a day");
+    check(host_off_ua() < 1.0, "%.2f uA after LVP", host_off_ua());
+    printf("power down: %.2f uA after LVP, BOD fused on\n", host_off_ua());
+    host_bod_fuse = 0;
+}
+
+/* Moon runs on a slower clock, with the ADC clock where it was,
+ * and the top level at full speed
+ */
+
+static void
+check_clock(void)
+{
+    double moon_ma, moon_hz;
+
+    fresh_cell();
+    host_run(10.0, 2.0);
+    moon_hz = host_cpu_hz();
+    moon_ma = host_idle_ma();
+    check(moon_hz < HOST_F_CPU, "moon at full speed");
+    check(host_adc_hz >= 50e3 && host_adc_hz <= 200e3,
+          "ADC clock %.1f kHz at moon", host_adc_hz / 1e3);
+
+    click_to(num_levels - 1, 2.0);
+    check(host_cpu_hz() == HOST_F_CPU, "top level at %.1f MHz",
+          host_cpu_hz() / 1e6);
+    check(host_adc_hz >= 50e3 && host_adc_hz <= 200e3,
+          "ADC clock %.1f kHz at the top", host_adc_hz / 1e3);
+
+    printf("clock: moon at %.1f MHz, chip idles on %.2f mA, "
+           "%.2f at full speed\n", moon_hz / 1e6, moon_ma, host_idle_ma());
+}
+
+/* A power cut while the count is being saved loses that save at
+ * most, and the count follows what the model took out of the cell.
+ */
+static void
+check_coulomb(void)
+{
+    uint16_t before, after;
+    double used;
+    int i;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+
+    // Cut at random times at the top level, then see what a
+    // short press (before the first tick) reads back
+    for (i = 0; i < 500; i++) {
+        click_to(num_levels - 1, (rand() % 10000) / 1000.0);
+        before = coul_used;
+        host_run(0.1, 0.01);
+        check(coul_used == before || coul_used + 1 == before,
+              "count %u read back as %u", before, coul_used);
+        if (host_cell.used_mah > host_cell.capacity_mah / 2)
+            fresh_cell();
+    }
+
+    // A cut between the two bytes of a save leaves the low byte of
+    // the entry after the newest one written.  The next save goes
+    // there, and must not come out ANDed into it.
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    click_to(num_levels - 2, 60.0);
+    for (i = 0; i < 16; i++)
+        if (host_eeprom[2*i + 1] != 0xff &&
+            host_eeprom[(2*i + 3) & 31] == 0xff)
+            break;
+    i = (i + 1) & 15;
+    host_eeprom[2*i] = 0x00;
+    host_run(0.1, 30.0);        // up to the top, a few more saves
+    before = host_eeprom[2*i] | host_eeprom[2*i + 1] << 8;
+    after = host_eeprom[(2*i + 2) & 31] | host_eeprom[(2*i + 3) & 31] << 8;
+    check(after == before + 1, "entry %d saved as %u, the next as %u",
+          i, before, after);
+
+    // A charged cell starts it over, then count ten minutes at the top
+    fresh_cell();
+    click_to(num_levels - 1, 600.0);
+    used = coul_used * COUL_MAH;
+    check(used <= host_cell.used_mah && used > host_cell.used_mah * 0.9,
+          "counted %.0f mAh of %.0f", used, host_cell.used_mah);
+}
+
+/* Ten quick clicks blink out the runtime at the level we were at.
+ * Digits are groups of blinks, a dim one is a zero.
+ */
+static void
+check_readout(void)
+{
+    double level_duty, bright = 0;
+    int i, j, run, digits[4], nd = 0, blinks = 0, dim = 0;
+    double hours, want;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    click_to(4, 1.0);
+    level_duty = host_duty();
+
+    for (i = 0; i < 9; i++)
+        host_run(0.1, 0.1);
+    ntrace = 0;
+    host_tick_hook = trace_tick;
+    host_run(0.1, 60.0);
+    host_tick_hook = NULL;
+
+    for (i = 0; i < ntrace; i++)
+        if (trace[i] > bright)
+            bright = trace[i];
+
+    // split the trace into groups of blinks at the long gaps
+    for (i = 0, run = 0; i < ntrace && trace[i] != level_duty; i++) {
+        if (trace[i] > 0) {
+            if (trace[i] < bright)
+                dim = 1;
+            else
+                blinks++;
+            run = 0;
+            continue;
+        }
+        if (++run == 5 && (blinks || dim) && nd < 4) {
+            digits[nd++] = blinks;
+            blinks = dim = 0;
+        }
+    }
+    check(i < ntrace, "never went back to the level");
+    check(nd >= 2, "only %d digits", nd);
+
+    hours = 0;
+    for (j = 0; j < nd; j++)
+        hours = hours * 10 + digits[j];
+    hours /= 10.0;
+    want = host_cell.capacity_mah / (level_duty * host_full_ma);
+    if (want > 99.9)
+        want = 99.9;
+    check(hours > want * 0.9 && hours < want * 1.1,
+          "read out %.1f h, wanted %.1f", hours, want);
+    printf("readout: %.1f h at %.1f%% duty\n", hours, level_duty * 100);
+}
+
+/* USE_COMPENSATION: the resting voltage comes down in steps from a
+ * full cell to just above ADC_LOW, a few ticks each, so LVP leaves
+ * the level alone.  The duty has to start where the ramp says, go up
+ * as the cell goes down and never back, up to about the top gain
+ * in COMP_GAINS (112, 1.75).
+ */
+#define COMP_STEPS  20
+#define COMP_TICKS  8           // ticks at each voltage
+
+static double comp_ratio[COMP_STEPS];
+static int comp_level;
+
+static void
+comp_tick(void)
+{
+    int step = rec_ticks / COMP_TICKS;
+
+    if (step >= COMP_STEPS)
+        return;
+    if (rec_ticks % COMP_TICKS == COMP_TICKS - 1)
+        comp_ratio[step] = host_duty() / level_duty[comp_level];
+    rec_ticks++;
+    rest_volts(4.0 - 0.05 * (rec_ticks / COMP_TICKS));
+}
+
+static void
+check_compensation(void)
+{
+    int i;
+
+    fresh_cell();
+    comp_level = num_levels - 3;
+    click_to(comp_level - 1, 1.0);
+    rec_ticks = 0;
+    rest_volts(4.0);
+    host_tick_hook = comp_tick;
+    host_run(0.1, (COMP_STEPS * COMP_TICKS + 2) * 0.256);
+    host_tick_hook = NULL;
+    check(level_idx == comp_level, "level_idx went to %d", level_idx);
+
+    check(comp_ratio[0] > 0.98 && comp_ratio[0] < 1.02,
+          "duty %.3f times the ramp on a full cell", comp_ratio[0]);
+    for (i = 1; i < COMP_STEPS; i++)
+        check(comp_ratio[i] >= comp_ratio[i-1],
+              "duty went down, %.3f to %.3f times the ramp at %.2f V",
+              comp_ratio[i-1], comp_ratio[i], 4.0 - 0.05 * i);
+    check(comp_ratio[COMP_STEPS-1] > 1.3 &&
+          comp_ratio[COMP_STEPS-1] < 112 / 64.0 + 0.02,
+          "duty %.3f times the ramp at %.2f V", comp_ratio[COMP_STEPS-1],
+          4.0 - 0.05 * (COMP_STEPS - 1));
+    printf("compensation: level %d, duty 1.00 to %.2f times the ramp "
+           "from 4.00 to %.2f V\n", comp_level, comp_ratio[COMP_STEPS-1],
+           4.0 - 0.05 * (COMP_STEPS - 1));
+    fresh_cell();
+}
+
+/* USE_REST_VOLTAGE: the cell resistance, worked out from the two
+ * readings, decides how far LVP steps back up.  The resting voltage
+ * goes down for a few step downs, as in check_recover(), then comes
+ * up to 3.4 V, above ADC_RECOVER.  On a good cell LVP has to step all
+ * the way back up.  On a tired one the level clicked would sag below
+ * ADC_LOW, so it has to stay one short of it, with the cell above
+ * ADC_LOW under load, and sag_full has to be well up.
+ */
+#define SAG_GOOD    0.1
+#define SAG_TIRED   0.6
+
+static void
+sag_tick(void)
+{
+    trace_tick();
+    rest_volts(rec_ticks++ < REC_LOW ? 2.9 : 3.4);
+}
+
+// Returns the cell voltage under load at the end
+static double
+sag_run(double ohms, int *downs, int *ups)
+{
+    double volts;
+    int i;
+
+    fresh_cell();
+    host_cell.ohms = ohms;
+    click_to(num_levels - 3, 1.0);
+    ntrace = 0;
+    rec_ticks = 0;
+    host_tick_hook = sag_tick;
+    host_run(0.1, 300 * 0.256);
+    host_tick_hook = NULL;
+    check(level_idx == num_levels - 2, "level_idx went to %d", level_idx);
+
+    *downs = *ups = 0;
+    for (i = 1; i < ntrace; i++) {
+        if (trace[i] < trace[i-1] * 0.9)
+            (*downs)++;
+        if (trace[i] > trace[i-1] * 1.1)
+            (*ups)++;
+    }
+    volts = host_volts();
+    host_cell.ohms = HOST_CELL_OHMS;
+    return volts;
+}
+
+static void
+check_sag(void)
+{
+    int downs, ups;
+    unsigned good;
+    double volts;
+
+    sag_run(SAG_GOOD, &downs, &ups);
+    good = sag_full;
+    check(downs > 0 && ups == downs,
+          "%.2f ohms: %d step downs, %d back up", SAG_GOOD, downs, ups);
+
+    volts = sag_run(SAG_TIRED, &downs, &ups);
+    check(downs > 1 && ups == downs - 1,
+          "%.2f ohms: %d step downs, %d back up", SAG_TIRED, downs, ups);
+    check(volts > 3.0, "%.2f ohms: %.3f V under load", SAG_TIRED, volts);
+    check(sag_full > 2 * good, "sag_full %u at %.2f ohms, %u at %.2f",
+          sag_full, SAG_TIRED, good, SAG_GOOD);
+    printf("sag: sag_full %u at %.2f ohms, %u at %.2f, which stays a level "
+           "down at %.3f V under load\n", good, SAG_GOOD, sag_full,
+           SAG_TIRED, volts);
+    fresh_cell();
+}
+
+/* The telemetry frames go out at one bit rate each, through LVP
+ * stepping down from the top to level 2 and back up, which changes
+ * the PWM mode and the clock both ways.  The pin goes to "csv" as
+ * time,level at each change, for bin/telemetry_decode.py.
+ */
+static FILE *telem_csv;
+static int telem_pin, telem_frames, telem_mixed, telem_sending;
+static double telem_bit_t;      // this frame's bit time
+
+static void
+telem_ovf(double t)
+{
+    int pin = (PORTB >> TELEM_PIN) & 1;
+    // The bit the interrupt just put out lasts until the next one
+    double bit = ((TCCR0A & 3) == 1 ? 510 : 256) / host_cpu_hz();
+
+    if (pin != telem_pin && telem_csv)
+        fprintf(telem_csv, "%.7f,%d\n", t, pin);
+    telem_pin = pin;
+
+    if (telem_left == TELEM_LEN - 1 && telem_bits == 9) {
+        telem_sending = 1;      // the start bit of the sync byte
+        telem_bit_t = bit;
+    }
+    if (telem_sending && bit != telem_bit_t)
+        telem_mixed++;
+    if (telem_sending && ! telem_left && ! telem_bits) {
+        telem_sending = 0;      // the stop bit of the last byte
+        telem_frames++;
+    }
+}
+
+static void
+telem_tick_volts(void)
+{
+    rest_volts(rec_ticks++ < 22 ? 2.9 : 3.7);
+}
+
+static void
+check_telemetry(const char *csv)
+{
+    int ticks;
+
+    fresh_cell();
+    telem_csv = csv ? fopen(csv, "w") : NULL;
+    check(! csv || telem_csv, "can't write %s", csv);
+    telem_pin = 1;
+    telem_frames = telem_mixed = telem_sending = 0;
+
+    click_to(num_levels - 2, 1.0);
+    rec_ticks = 0;
+    host_tick_hook = telem_tick_volts;
+    host_ovf_hook = telem_ovf;
+    host_run(0.1, 300 * 0.256);
+    host_ovf_hook = NULL;
+    host_tick_hook = NULL;
+    ticks = rec_ticks;          // telem_tick wraps
+
+    check(telem_mixed == 0, "%d bits at another bit rate", telem_mixed);
+    check(telem_frames >= ticks - 1, "%d frames in %d ticks",
+          telem_frames, ticks);
+    printf("telemetry: %d frames in %d ticks, %d bits at another rate\n",
+           telem_frames, ticks, telem_mixed);
+    if (telem_csv)
+        fclose(telem_csv);
+    fresh_cell();
+}
+
+/* ---------------------------------------------------------------- */
+
+static void
+bench(long n)
+{
+    clock_t t0 = clock();
+    double sim0 = host_time;
+    double secs;
+    long i;
+
+    fresh_cell();
+    for (i = 0; i < n; i++) {
+        if (host_cell.used_mah > host_cell.capacity_mah * 0.9)
+            fresh_cell();
+        host_run(rand() % 4 ? 0.1 : 2.0, (rand() % 3000) / 1000.0);
+    }
+    secs = (double) (clock() - t0) / CLOCKS_PER_SEC;
+    printf("%ld clicks in %.2f s: %.0f clicks/s, %.0f simulated s/s\n",
+           n, secs, n / secs, (host_time - sim0) / secs);
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *csv = NULL;
+
+    if (argc == 3 && strcmp(argv[1], "-b") == 0) {
+        bench(atol(argv[2]));
+        return 0;
+    }
+    if (argc == 3 && strcmp(argv[1], "-t") == 0)
+        csv = argv[2];
+    else if (argc != 1) {
+        fprintf(stderr, "usage: biscuit-host [-t capture | -b clicks]\n");
+        return 1;
+    }
+
+    check_clicks();
+    check_first_light();
+    check_discharge(HOST_CELL_OHMS);
+    check_discharge(0.5);
+    check_discharge(1.0);
+    check_recover();
+    check_power();
+    check_clock();
+    if (&duty_gain)
+        check_compensation();
+    if (&sag_full)
+        check_sag();
+    if (&coul_used) {
+        check_coulomb();
+        check_readout();
+    }
+    if (&telem_tick)
+        check_telemetry(csv);
+
+    printf("%d checks, %d failed\n", checks, failed);
+    return failed ? 1 : 0;
+}
+
+/* THE END */
@@ -0,0 +1,782 @@
+/*
+ * hal-host.c -- a model of the ATtiny13A and the battery, for
+ * running the Convoy firmware as a host program, see hal-host.h
+ *
+ * Only what the firmware needs is modelled: timer 0 as a PWM duty
+ * and its overflow interrupt, the ADC on the battery, the watchdog
+ * interrupt, the EEPROM, and sleep.  Time only goes by when the
+ * firmware sleeps or busy waits, a whole watchdog tick at a time in
+ * idle sleep, so a run of hours takes milliseconds.
+ *
+ * A power cycle longjmp()s out of the firmware, wherever it is, and
+ * starts fw_main() over.  Before that the firmware's .data and .bss
+ * go back to how they started, like the AVR startup code does.  The
+ * Makefile renames those sections to fw_data and fw_bss (and .noinit
+ * to fw_noinit) in the firmware object, so the linker gives us their
+ * bounds and the harness's own variables are left alone.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <avr/eeprom.h>
+
+#include "hal-host.h"
+
+volatile uint8_t DDRB, PORTB, PINB;
+volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B;
+volatile uint8_t ADMUX, ADCH, DIDR0;
+volatile uint16_t ADC;
+volatile uint8_t MCUCR, EEARL, EEDR, SREG;
+volatile uint8_t OSCCAL, CLKPR, PRR, ACSR, BODCR;
+
+static volatile uint8_t timsk0, adcsra, eecr, tcnt0, tifr0, wdtcr;
+static long tov_seen, tov_cleared; // timer 0 overflows, as of the last
+                                // look at TOV0 and when it was cleared
+static int wdtif;               // the watchdog timed out, with WDTIE
+static uint8_t adcsra_stopped;  // ADCSRA when PRR stopped the ADC
+static int adc_stopped;
+
+struct host_cell host_cell = { 3000.0, 0.0, HOST_CELL_OHMS };
+double host_full_ma = 2800.0;
+double host_time;
+uint8_t host_eeprom[HOST_EEPSIZE];
+void (*host_tick_hook)(void);
+void (*host_ovf_hook)(double t);
+void (*host_light_hook)(double t, double duty);
+int host_bod_fuse;
+int host_eeprom_tear;
+double host_adc_hz;
+double host_rc = 1.0;
+struct host_stats host_stats;
+double host_first_light;
+
+static jmp_buf host_jmp;
+static int dithering;           // the overflow interrupt keeps changing OCR0B
+static double dither_duty;      // and this is the average
+static double host_end;         // when the power goes
+static double wdt_last;         // last watchdog tick
+static double timer_start;      // when timer 0 was last at BOTTOM, give or take periods
+static int bod_slept;           // BODS was set for this sleep
+static int in_isr;
+static int asleep;              // time going by is sleep, not busy waiting
+static double since_reset;      // CPU cycles since power on
+
+/* Whatever interrupts the firmware doesn't have
+ */
+#define NO_ISR(v)   __attribute__ ((weak)) void v(void) { }
+NO_ISR(TIM0_OVF_vect)
+NO_ISR(TIM0_COMPA_vect)
+NO_ISR(EE_RDY_vect)
+NO_ISR(WDT_vect)
+NO_ISR(ADC_vect)
+
+// The firmware's sections, see the Makefile
+extern char __start_fw_data[] __attribute__ ((weak));
+extern char __stop_fw_data[] __attribute__ ((weak));
+extern char __start_fw_bss[] __attribute__ ((weak));
+extern char __stop_fw_bss[] __attribute__ ((weak));
+extern char __start_fw_noinit[] __attribute__ ((weak));
+extern char __stop_fw_noinit[] __attribute__ ((weak));
+
+static char *fw_data_image;
+
+/* ---------------------------------------------------------------- */
+
+/* Open circuit voltage against charge left, a typical 18650
+ */
+static const double ocv_table[][2] = {
+    { 0.00, 2.80 }, { 0.03, 3.20 }, { 0.08, 3.40 }, { 0.20, 3.55 },
+    { 0.40, 3.68 }, { 0.60, 3.82 }, { 0.80, 3.98 }, { 1.00, 4.18 },
+};
+
+double
+host_rest_volts(void)
+{
+    double soc = 1.0 - host_cell.used_mah / host_cell.capacity_mah;
+    int i;
+
+    if (soc <= 0)
+        return ocv_table[0][1];
+    for (i = 1; i < sizeof ocv_table / sizeof ocv_table[0] - 1; i++)
+        if (soc < ocv_table[i][0])
+            break;
+    return ocv_table[i-1][1] + (soc - ocv_table[i-1][0]) *
+        (ocv_table[i][1] - ocv_table[i-1][1]) / (ocv_table[i][0] - ocv_table[i-1][0]);
+}
+
+static double
+pwm_duty(void)
+{
+    uint8_t wgm = TCCR0A & 3;
+
+    if (! (DDRB & (1 << PB1)))
+        return 0;
+    if (! (TCCR0A & (1 << COM0B1)) || ! (TCCR0B & 7) || ! wgm)
+        return (PORTB & (1 << PB1)) ? 1.0 : 0.0;
+    if (wgm == 1)
+        return OCR0B / 255.0;
+    return (OCR0B + 1) / 256.0;
+}
+
+/* Where timer 0 is in its PWM period.  It counts from timer_start,
+ * which a conversion in ADC sleep (the timer frozen) moves up, and
+ * each watchdog tick moves by a random amount: the watchdog runs off
+ * its own oscillator, not in step with the timer.
+ */
+static int
+timer_count(void)
+{
+    long n = (long) ((host_time - timer_start) * host_cpu_hz()) & 0x7fffffff;
+
+    if ((TCCR0A & 3) == 1) {            // phase correct, up and down
+        n %= 510;
+        return n < 256 ? n : 510 - n;
+    }
+    return n & 0xff;
+}
+
+/* The PWM pin right now, not averaged over the period like
+ * pwm_duty(): the LED is either on at full current, or off.
+ */
+static int
+pin_high(void)
+{
+    uint8_t wgm = TCCR0A & 3;
+    int n;
+
+    if (! (DDRB & (1 << PB1)))
+        return 0;
+    if (! (TCCR0A & (1 << COM0B1)) || ! (TCCR0B & 7) || ! wgm)
+        return (PORTB & (1 << PB1)) != 0;
+    n = timer_count();
+    if (wgm == 1)
+        return n < OCR0B;
+    return n <= OCR0B;
+}
+
+/* The average only holds while the overflow interrupt runs,
+ * not while something (a resting voltage reading) holds it off
+ */
+double
+host_duty(void)
+{
+    return dithering && (timsk0 & (1 << TOIE0)) ? dither_duty : pwm_duty();
+}
+
+/* The 7135s hold their current until the cell gets within
+ * a few hundred mV of the LED, then fall off.
+ */
+static double
+on_ma(double volts)
+{
+    if (volts >= 3.30)
+        return host_full_ma;
+    if (volts <= 2.80)
+        return 0;
+    return host_full_ma * (volts - 2.80) / 0.50;
+}
+
+static double
+loaded_volts(double duty, double *ma)
+{
+    double rest = host_rest_volts();
+    double lo = 0, hi = rest, v;
+    int n;
+
+    // V = rest - I(V) R has one solution, I(V) only goes up with V.
+    // Bisect for it: just going round V = rest - I(V) R swings
+    // further out each time once R is much over 0.15 ohms.
+    for (n = 0; n < 40; n++) {
+        v = (lo + hi) / 2;
+        if (v > rest - duty * on_ma(v) / 1000.0 * host_cell.ohms)
+            hi = v;
+        else
+            lo = v;
+    }
+    v = (lo + hi) / 2;
+    if (ma)
+        *ma = duty * on_ma(v);
+    return v;
+}
+
+double
+host_ma(void)
+{
+    double ma;
+
+    loaded_volts(host_duty(), &ma);
+    return ma;
+}
+
+double
+host_volts(void)
+{
+    return loaded_volts(host_duty(), NULL);
+}
+
+/* ---------------------------------------------------------------- */
+
+static void
+run_isr(void (*isr)(void))
+{
+    uint8_t sreg = SREG;
+
+    SREG = sreg & ~0x80;
+    in_isr = 1;
+    isr();
+    in_isr = 0;
+    SREG = sreg;
+}
+
+#define ints_on()   ((SREG & 0x80) && ! in_isr)
+
+// The system clock, after the prescaler
+double
+host_cpu_hz(void)
+{
+    double trim = 1 + HOST_OSCCAL_STEP * ((OSCCAL & 0x7f) - HOST_OSCCAL);
+
+    return host_rc * trim * HOST_F_CPU / (1 << (CLKPR & 0x0f));
+}
+
+// Seconds from one timer 0 overflow to the next
+static double
+pwm_period(void)
+{
+    return ((TCCR0A & 3) == 1 ? 510 : 256) / host_cpu_hz();
+}
+
+/* Run the overflow interrupt for a few PWM periods, and keep the
+ * average duty, for firmware that dithers OCR0B from one period
+ * to the next.  With host_ovf_hook, run it for every period from
+ * t0 to t0 + dt instead, and call the hook after each.
+ */
+#define DITHER_PERIODS  16
+
+static void
+pwm_periods(double t0, double dt)
+{
+    static double next;         // the next overflow, for the hook
+    double sum = 0;
+    int n;
+
+    if (host_ovf_hook) {
+        if (next <= t0 || next > t0 + pwm_period())
+            next = t0 + pwm_period();
+        while ((timsk0 & (1 << TOIE0)) && next <= t0 + dt) {
+            run_isr(TIM0_OVF_vect);
+            host_ovf_hook(next);
+            next += pwm_period();
+        }
+        dithering = 0;
+        return;
+    }
+
+    for (n = 0; n < DITHER_PERIODS && (timsk0 & (1 << TOIE0)); n++) {
+        run_isr(TIM0_OVF_vect);
+        sum += pwm_duty();
+    }
+    dither_duty = (sum + (DITHER_PERIODS - n) * pwm_duty()) / DITHER_PERIODS;
+    dithering = (timsk0 & (1 << TOIE0)) != 0;
+}
+
+static void
+eeprom_finish(void)
+{
+    uint8_t a = EEARL & (HOST_EEPSIZE-1);
+
+    switch ((eecr >> EEPM0) & 3) {
+    case 0:
+        host_eeprom[a] = EEDR;
+        break;
+    case 1:
+        host_eeprom[a] = 0xff;
+        break;
+    case 2:
+        host_eeprom[a] &= EEDR;
+        break;
+    }
+    eecr &= ~((1 << EEPE) | (1 << EEMPE));
+}
+
+/* The power went in the middle of a write: some of the bits took,
+ * some didn't
+ */
+static void
+eeprom_cut(void)
+{
+    uint8_t a = EEARL & (HOST_EEPSIZE-1);
+    uint8_t was = host_eeprom[a], want = EEDR, some = rand();
+
+    if (((eecr >> EEPM0) & 3) == 1)
+        want = 0xff;
+    else if (((eecr >> EEPM0) & 3) == 2)
+        want &= was;
+    host_eeprom[a] = (was & ~some) | (want & some);
+    eecr &= ~((1 << EEPE) | (1 << EEMPE));
+}
+
+/* Count dt seconds going by in host_stats, and when the LED came on
+ */
+static void
+count(double dt)
+{
+    double cycles = dt * host_cpu_hz();
+
+    if (host_first_light < 0 && host_duty() > 0)
+        host_first_light = since_reset;
+    since_reset += cycles;
+    if (asleep)
+        host_stats.sleep += cycles;
+    else
+        host_stats.active += cycles;
+    if ((adcsra & (1 << ADEN)) && ! (PRR & (1 << PRADC)))
+        host_stats.adc_on += dt;
+    host_stats.light += host_duty() * dt;
+}
+
+/* The overflow interrupt's PWM periods from t0 to t0 + dt,
+ * "start" cycles after power on, when the light may have come on
+ * at the first of them
+ */
+static void
+overflows(double start, double t0, double dt)
+{
+    pwm_periods(t0, dt);
+    if (host_first_light < 0 && host_duty() > 0)
+        host_first_light = start + ((TCCR0A & 3) == 1 ? 510 : 256);
+}
+
+/* Let dt seconds go by, or up to when the power goes.
+ * A pending EEPROM write is done by then (it takes a few ms,
+ * so a cut right after it starts loses it, or with host_eeprom_tear
+ * leaves it half done), and a PWM
+ * period has gone by for the overflow interrupt.
+ */
+static void
+advance(double dt)
+{
+    static double duty;         // for host_light_hook
+    double ma = host_ma();
+    double start = since_reset;
+
+    if (host_light_hook && host_duty() != duty)
+        host_light_hook(host_time, host_duty());
+    duty = host_duty();
+
+    if (host_time + dt >= host_end) {
+        host_cell.used_mah += ma * (host_end - host_time) / 3600.0;
+        count(host_end - host_time);
+        if ((eecr & (1 << EEPE)) && host_eeprom_tear)
+            eeprom_cut();
+        if (host_end > host_time && (timsk0 & (1 << TOIE0)) && ints_on())
+            overflows(start, host_time, host_end - host_time);
+        host_time = host_end;
+        longjmp(host_jmp, HOST_CUT);
+    }
+    host_cell.used_mah += ma * dt / 3600.0;
+    count(dt);
+    host_time += dt;
+
+    if (eecr & (1 << EEPE))
+        eeprom_finish();
+    if ((eecr & (1 << EERIE)) && ints_on())
+        run_isr(EE_RDY_vect);
+    if ((timsk0 & (1 << TOIE0)) && ints_on())
+        overflows(start, host_time - dt, dt);
+}
+
+void
+host_delay_cycles(uint32_t cycles)
+{
+    advance(cycles / host_cpu_hz());
+}
+
+/* One conversion, left adjusted like the firmware sets it up.
+ * ADC1 (PB2) is the battery, through the divider: about
+ * 42 counts per volt plus 7, in 8 bits.
+ * The sample and hold takes the cell as it is at the start, with
+ * the LED on at full current or off, whatever the pin is doing then.
+ */
+static void
+adc_convert(void)
+{
+    double v = 0;
+    int adc10;
+    int div = 1 << (adcsra & 7);
+
+    if ((ADMUX & 0x0f) == 1)
+        v = loaded_volts(pin_high() ? 1.0 : 0.0, NULL);
+
+    host_adc_hz = host_cpu_hz() / (div > 1 ? div : 2);
+    advance(13 / host_adc_hz);
+
+    adc10 = (int) ((42.0 * v + 7.0) * 4.0) + (rand() % 3) - 1;
+    if (adc10 < 0)
+        adc10 = 0;
+    if (adc10 > 1023)
+        adc10 = 1023;
+    if (ADMUX & (1 << ADLAR)) {
+        ADC = adc10 << 6;
+        ADCH = adc10 >> 2;
+    } else {
+        ADC = adc10;
+        ADCH = adc10 >> 8;
+    }
+    adcsra = (adcsra & ~(1 << ADSC)) | (1 << ADIF);
+}
+
+/* The registers with side effects, see avr/io.h
+ * Each access first catches up with whatever the last one started.
+ * With host_ovf_hook, that is a few cycles of polling instead, and
+ * the interrupt comes at its overflow like the others.
+ */
+volatile uint8_t *
+host_timsk0(void)
+{
+    if ((timsk0 & (1 << TOIE0)) && ints_on()) {
+        if (host_ovf_hook)
+            advance(4 / host_cpu_hz());
+        else
+            run_isr(TIM0_OVF_vect);
+    }
+    return &timsk0;
+}
+
+// Each read is a few cycles of a busy loop
+volatile uint8_t *
+host_tcnt0(void)
+{
+    count(4 / host_cpu_hz());
+    host_time += 4 / host_cpu_hz();
+    tcnt0 = timer_count();
+    return &tcnt0;
+}
+
+volatile uint8_t *
+host_adcsra(void)
+{
+    // With its clock stopped (PRR), writes to the ADC don't take.
+    // We only see them afterwards, so put back what it held.
+    if (PRR & (1 << PRADC)) {
+        if (! adc_stopped)
+            adcsra_stopped = adcsra;
+        adc_stopped = 1;
+    }
+    if (adc_stopped) {
+        adcsra = adcsra_stopped;
+        adc_stopped = (PRR & (1 << PRADC)) != 0;
+    }
+
+    if ((adcsra & (1 << ADSC)) && (adcsra & (1 << ADEN))) {
+        // With its clock stopped, the chip can't even set ADSC
+        if (PRR & (1 << PRADC))
+            adcsra &= ~(1 << ADSC);
+        else
+            adc_convert();
+    }
+    return &adcsra;
+}
+
+volatile uint8_t *
+host_eecr(void)
+{
+    if (eecr & (1 << EEPE))
+        advance(((eecr >> EEPM0) & 3) ? 0.0018 : 0.0034);
+    else if ((eecr & (1 << EERIE)) && ints_on())
+        run_isr(EE_RDY_vect);
+    return &eecr;
+}
+
+/* The flags, which the firmware polls with interrupts off.  Writing
+ * a one clears them, which we only see at the next access: a flag
+ * still set then was written back (or just read, before the write
+ * that clears it).  Each access is a few cycles of a busy loop.
+ */
+static double wdt_period(void);
+
+static long
+tov_count(void)
+{
+    if (! (TCCR0B & 7))
+        return tov_seen;
+    return (long) ((host_time - timer_start) / pwm_period());
+}
+
+volatile uint8_t *
+host_tifr0(void)
+{
+    if (tifr0 & (1 << TOV0))
+        tov_cleared = tov_seen;
+    count(4 / host_cpu_hz());
+    host_time += 4 / host_cpu_hz();
+    tov_seen = tov_count();
+    tifr0 = tov_seen != tov_cleared ? (1 << TOV0) : 0;
+    return &tifr0;
+}
+
+// With interrupts on, host_sleep() runs the interrupt instead
+volatile uint8_t *
+host_wdtcr(void)
+{
+    if (wdtcr & (1 << WDTIF))
+        wdtif = 0;
+    if ((wdtcr & (1 << WDTIE)) && ! ints_on()) {
+        count(4 / host_cpu_hz());
+        host_time += 4 / host_cpu_hz();
+        while (wdt_last + wdt_period() <= host_time) {
+            wdt_last += wdt_period();
+            wdtif = 1;
+        }
+    }
+    wdtcr = (wdtcr & ~(1 << WDTIF)) | (wdtif ? (1 << WDTIF) : 0);
+    return &wdtcr;
+}
+
+uint8_t
+eeprom_read_byte(const uint8_t *addr)
+{
+    return host_eeprom[(uintptr_t) addr & (HOST_EEPSIZE-1)];
+}
+
+uint16_t
+eeprom_read_word(const uint16_t *addr)
+{
+    uintptr_t a = (uintptr_t) addr & (HOST_EEPSIZE-1);
+
+    return host_eeprom[a] | host_eeprom[(a+1) & (HOST_EEPSIZE-1)] << 8;
+}
+
+void
+eeprom_write_byte(uint8_t *addr, uint8_t data)
+{
+    eeprom_busy_wait();
+    advance(0.0034);
+    host_eeprom[(uintptr_t) addr & (HOST_EEPSIZE-1)] = data;
+}
+
+void
+eeprom_update_byte(uint8_t *addr, uint8_t data)
+{
+    if (eeprom_read_byte(addr) != data)
+        eeprom_write_byte(addr, data);
+}
+
+/* ---------------------------------------------------------------- */
+
+static double
+wdt_period(void)
+{
+    int p = (wdtcr & 7) | ((wdtcr & (1 << WDP3)) ? 8 : 0);
+
+    return 0.016 * (1 << p);
+}
+
+void
+host_wdt_reset(void)
+{
+    wdt_last = host_time;
+}
+
+void
+host_sleep(void)
+{
+    uint8_t mode = MCUCR & ((1 << SM1) | (1 << SM0));
+
+    // BODS only lasts for the sleep right after it is set
+    bod_slept = (BODCR & (1 << BODS)) != 0;
+    BODCR = 0;
+
+    if (mode == SLEEP_MODE_ADC && (adcsra & (1 << ADEN)) &&
+            ! (PRR & (1 << PRADC))) {
+        double t = host_time;
+
+        // clk_IO stops, and timer 0 and the PWM pin with it
+        adcsra |= (1 << ADSC);
+        asleep = 1;
+        adc_convert();
+        asleep = 0;
+        timer_start += host_time - t;
+        if ((adcsra & (1 << ADIE)) && ints_on())
+            run_isr(ADC_vect);
+        return;
+    }
+
+    // Nothing left to wake us, the light is off for good
+    // (in power down, only the watchdog can).  A write that was
+    // going still goes through, the EEPROM times itself.
+    if (! ints_on() ||
+            (mode == SLEEP_MODE_PWR_DOWN && ! (wdtcr & (1 << WDTIE)))) {
+        if (eecr & (1 << EEPE))
+            eeprom_finish();
+        longjmp(host_jmp, HOST_OFF);
+    }
+
+    // The compare interrupt (_delay_4ms() in biscotti) wakes us every
+    // PWM period, so it comes first unless the watchdog is due now.
+    // The overflow interrupt would too, but the firmware that uses it
+    // only waits for the watchdog, so we skip ahead (see advance()).
+    if (mode == SLEEP_MODE_IDLE && (timsk0 & (1 << OCIE0A)) &&
+            ! ((wdtcr & (1 << WDTIE)) &&
+               wdt_last + wdt_period() <= host_time + 256 / host_cpu_hz())) {
+        asleep = 1;
+        advance(256 / host_cpu_hz());
+        asleep = 0;
+        run_isr(TIM0_COMPA_vect);
+    } else if (wdtcr & (1 << WDTIE)) {
+        double next = wdt_last + wdt_period();
+
+        if (next < host_time)
+            next = host_time;
+        asleep = 1;
+        advance(next - host_time);
+        asleep = 0;
+        wdt_last = next;
+        timer_start -= (rand() % 510) / host_cpu_hz();
+        run_isr(WDT_vect);
+        if (host_tick_hook)
+            host_tick_hook();
+    } else if (timsk0 & (1 << TOIE0)) {
+        asleep = 1;
+        advance(256 / host_cpu_hz());
+        asleep = 0;
+    } else {
+        longjmp(host_jmp, HOST_OFF);
+    }
+}
+
+/* What the chip draws in power down, as it was left.  Rough typicals
+ * at 3 V, from the ATtiny13A datasheet and bench reports, good enough
+ * to tell what was left on.  The divider on PB2 is not counted.
+ */
+#define UA_POWER_DOWN   0.15
+#define UA_WDT          4.0
+#define UA_BOD          17.0
+#define UA_ADC          230.0   // enabled, with the bandgap reference
+
+double
+host_off_ua(void)
+{
+    double ua = UA_POWER_DOWN;
+
+    if (wdtcr & ((1 << WDTIE) | (1 << WDE)))
+        ua += UA_WDT;
+    if (adcsra & (1 << ADEN))
+        ua += UA_ADC;
+    if (host_bod_fuse && ! bod_slept)
+        ua += UA_BOD;
+    return ua;
+}
+
+/* What the chip draws idling, running at this clock (the ADC, if
+ * it was left on, comes on top).  About 0.3 mA at 4.8 MHz and 3 V.
+ */
+#define MA_IDLE_PER_MHZ 0.06
+
+double
+host_idle_ma(void)
+{
+    double ma = MA_IDLE_PER_MHZ * host_cpu_hz() / 1e6;
+
+    if (adcsra & (1 << ADEN))
+        ma += UA_ADC / 1000.0;
+    return ma;
+}
+
+/* PB0 to PB4 left as inputs with no pull-up and the input buffer on.
+ * PB5 is RESET, which has its pull-up.
+ */
+uint8_t
+host_floating(void)
+{
+    return ~(DDRB | PORTB | DIDR0) & 0x1f;
+}
+
+/* ---------------------------------------------------------------- */
+
+static void
+power_on_reset(void)
+{
+    size_t n;
+
+    DDRB = PORTB = PINB = 0;
+    TCCR0A = TCCR0B = OCR0A = OCR0B = tifr0 = 0;
+    ADMUX = ADCH = DIDR0 = 0;
+    ADC = 0;
+    wdtcr = MCUCR = EEARL = EEDR = SREG = 0;
+    wdtif = 0;
+    tov_seen = tov_cleared = 0;
+    CLKPR = PRR = ACSR = BODCR = 0;
+    OSCCAL = HOST_OSCCAL;
+    timsk0 = adcsra = eecr = tcnt0 = 0;
+    timer_start = host_time;
+    adc_stopped = 0;
+    in_isr = dithering = 0;
+    bod_slept = 0;
+    asleep = 0;
+    since_reset = 0;
+    host_first_light = -1;
+
+    n = __stop_fw_data - __start_fw_data;
+    if (n) {
+        if (! fw_data_image) {
+            fw_data_image = malloc(n);
+            memcpy(fw_data_image, __start_fw_data, n);
+        }
+        memcpy(__start_fw_data, fw_data_image, n);
+    }
+    n = __stop_fw_bss - __start_fw_bss;
+    if (n)
+        memset(__start_fw_bss, 0, n);
+}
+
+int
+host_run(double off, double on)
+{
+    static int cold = 1;
+    char *p;
+    int why;
+
+    host_time += off;
+
+    // RAM fades to anything but all zeros
+    if (cold || off >= HOST_RAM_FADE)
+        for (p = __start_fw_noinit; p < __stop_fw_noinit; p++)
+            *p = rand() % 255 + 1;
+    if (cold)
+        memset(host_eeprom, 0xff, sizeof host_eeprom);
+    cold = 0;
+
+    power_on_reset();
+    host_end = host_time + on;
+    wdt_last = host_time;
+
+    why = setjmp(host_jmp);
+    if (! why) {
+        fw_main();
+        why = HOST_OFF;
+    }
+    return why;
+}
+
+/* THE END */
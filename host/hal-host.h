@@ -0,0 +1,115 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+/*
+ * hal-host.h -- run the Convoy firmware as a host program
+ *
+ * The firmware talks to the chip through avr-libc (registers, sleep,
+ * PROGMEM, EEPROM) and the tk-*.h headers on top of that.  This
+ * directory has stand-ins for the avr-libc headers, so the same C
+ * compiles with the host gcc against a model of the ATtiny13A and a
+ * battery, in hal-host.c.  See README.md.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#define HOST_F_CPU      4800000.0
+#define HOST_EEPSIZE    64
+#define HOST_CELL_OHMS  0.15    // a good cell, what host_cell starts with
+
+/* The cell.  The open circuit voltage follows the charge left,
+ * and it sags by the LED current times ohms.
+ */
+struct host_cell {
+    double capacity_mah;
+    double used_mah;        // taken out so far
+    double ohms;            // cell, spring and wiring
+};
+
+extern struct host_cell host_cell;
+extern double host_full_ma;     // LED current at full duty, good cell
+extern double host_time;        // seconds since the first power on
+extern uint8_t host_eeprom[HOST_EEPSIZE];
+// A cut in the middle of an EEPROM write leaves some of its bits
+// done, rather than the whole write lost
+extern int host_eeprom_tear;
+
+// Called at every watchdog tick, after the firmware's ISR
+extern void (*host_tick_hook)(void);
+// Called after each timer 0 overflow interrupt, at its time, and
+// while it is set, the model runs every one of them (only a few
+// otherwise, see pwm_periods())
+extern void (*host_ovf_hook)(double t);
+// Called when time starts going by at another PWM duty (the firmware
+// changed the level since the last wait), with the time and the duty
+extern void (*host_light_hook)(double t, double duty);
+
+// Why host_run() came back
+#define HOST_CUT    1       // the time was up (the user clicked)
+#define HOST_OFF    2       // the firmware powered itself down
+
+/* Leave the power off for "off" seconds, then run the firmware for
+ * up to "on" seconds.  After HOST_RAM_FADE seconds off, the .noinit
+ * variables are scrambled, like RAM in a real light.
+ * The registers keep their last values until the next call.
+ */
+#define HOST_RAM_FADE   0.5
+
+int host_run(double off, double on);
+
+double host_duty(void);         // PWM duty out of 1.0, from the registers
+double host_ma(void);           // LED current right now
+double host_volts(void);        // cell voltage under the average load
+double host_rest_volts(void);   // open circuit
+
+double host_cpu_hz(void);       // system clock, after CLKPR
+// The RC oscillator against its nominal 9.6 MHz at the factory trim,
+// which is only good to 10%; the watchdog's own oscillator is exact.
+// Each step of OSCCAL from there is HOST_OSCCAL_STEP more or less.
+extern double host_rc;
+#define HOST_OSCCAL         0x50
+#define HOST_OSCCAL_STEP    0.009
+extern double host_adc_hz;      // ADC clock for the last conversion
+double host_idle_ma(void);      // what the chip draws idling (rough)
+
+/* What the chip did, for bench-host.c.  Time only goes by in busy
+ * waits (delay loops, EEPROM writes, polling the timer) and in sleep,
+ * so "active" is the busy waiting.  Zero it to start counting.
+ */
+struct host_stats {
+    double active;          // CPU cycles busy waiting
+    double sleep;           // CPU cycles asleep, any sleep mode
+    double adc_on;          // seconds with the ADC enabled and clocked
+    double light;           // seconds times PWM duty
+};
+extern struct host_stats host_stats;
+
+// CPU cycles from the last power on until the LED came on (OCR0B
+// set, with the pin on the timer), or -1 while it hasn't.  Code
+// between waits takes no time in the model, so this is the waits
+// before it.
+extern double host_first_light;
+
+// After HOST_OFF, what the chip draws in power down (uA, rough)
+extern int host_bod_fuse;       // BODLEVEL fuses set, the Makefiles don't
+double host_off_ua(void);
+uint8_t host_floating(void);    // a bit for each floating pin of PB0-PB4
+
+// The firmware's main(), renamed by the Makefile
+int fw_main(void);
+
+#endif  // HAL_HOST_H
@@ -0,0 +1,308 @@
+/*
+ * simple-host -- checks for simple, built for the host against
+ * hal-host.c (see README.md)
+ *
+ * usage: simple-host             run the checks
+ *        simple-host -e FILE     the same, and with USE_STATS write
+ *                                the EEPROM to FILE, as avrdude's :r
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <avr/io.h>
+
+#include "hal-host.h"
+
+// From simple.c
+extern uint8_t mode_idx;
+extern uint8_t solid_modes;
+extern uint8_t modegroup;
+extern const uint8_t modegroups[];
+// Only there with USE_STATS
+extern void stat_add(uint8_t addr) __attribute__ ((weak));
+// Only there with USE_DELAY_CAL
+extern uint16_t delay_loops __attribute__ ((weak));
+
+// From tk-stats.h
+#define STAT_BASE       (HOST_EEPSIZE/2)
+#define STAT_LEVELS     8
+#define STAT_boots_ones (STAT_BASE)
+#define STAT_boots      (STAT_BASE+1)
+#define STAT_minutes    (STAT_BASE+3)
+#define STAT_stepdowns  (STAT_minutes + 2*STAT_LEVELS)
+#define STAT_shutdowns  (STAT_stepdowns+2)
+#define STAT_minvolt    (STAT_shutdowns+2)
+
+#define OPT_modegroup   (HOST_EEPSIZE-1)
+#define OPT_memory      (HOST_EEPSIZE-2)
+#define OPT_mode_override (HOST_EEPSIZE-3)
+#define OPT_delay_cal   (HOST_EEPSIZE-5)
+
+static int failed;
+static int checks;
+
+#define check(cond, ...) \
+    do { \
+        checks++; \
+        if (! (cond)) { \
+            failed++; \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+static void
+fresh_cell(void)
+{
+    host_cell.used_mah = 0;
+}
+
+// Take enough out of the cell to bring it to "v" at rest
+static void
+rest_volts(double v)
+{
+    double lo = 0, hi = host_cell.capacity_mah;
+    int n;
+
+    for (n = 0; n < 40; n++) {
+        host_cell.used_mah = (lo + hi) / 2;
+        if (host_rest_volts() > v)
+            lo = host_cell.used_mah;
+        else
+            hi = host_cell.used_mah;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+/* A long press starts at the first mode, each short press goes to
+ * the next, and the last wraps around to the first again.
+ * The first five of group 0 are solid, and get brighter.
+ */
+static void
+check_clicks(void)
+{
+    double duty[5];
+    int i, n;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);
+    n = solid_modes;
+    duty[0] = host_duty();
+    check(mode_idx == 0, "long press gave mode %d", mode_idx);
+    check(duty[0] > 0, "light is off in mode 0");
+
+    for (i = 1; i < n; i++) {
+        host_run(0.1, 1.0);
+        check(mode_idx == i, "short press %d gave mode %d", i, mode_idx);
+        if (i < 5) {
+            duty[i] = host_duty();
+            check(duty[i] > duty[i-1], "mode %d duty %.4f not above %.4f",
+                  i, duty[i], duty[i-1]);
+        }
+    }
+    host_run(0.1, 1.0);
+    check(mode_idx == 0, "mode %d didn't wrap around", n-1);
+
+    host_run(0.1, 1.0);
+    host_run(5.0, 1.0);
+    check(mode_idx == 0, "long press from mode 1 gave mode %d", mode_idx);
+}
+
+/* Solid modes light up before saving the mode or anything else
+ * that waits (the baseline firmware saved first, 33472 cycles)
+ */
+static void
+check_first_light(void)
+{
+    int i;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);            // first boot, saves the defaults
+    host_run(10.0, 1.0);
+    for (i = 0; i < 5; i++) {
+        check(host_first_light == 0, "light on %.0f cycles into mode %d",
+              host_first_light, mode_idx);
+        host_run(0.1, 1.0);
+    }
+}
+
+/* USE_STATS: a first boot and some clicks in group 1 (all solid),
+ * a few minutes in one mode, then a cell that runs out, which LVP
+ * steps down and shuts off.  Every click is a boot, the minutes go
+ * to the level of that mode, and the low cell shows in the step
+ * downs, the shutdown and the lowest voltage.
+ */
+#define STATS_CLICKS    20
+#define STATS_MINUTES   5
+
+// Stored counter to count, as in tk-stats.h and bin/stats_decode.py
+static int
+stat_count(int addr)
+{
+    unsigned v = host_eeprom[addr] | (host_eeprom[addr + 1] << 8);
+
+    if (! (v & 0x100))
+        v ^= 0xff;
+    return ~v & 0xffff;
+}
+
+static void
+check_stats(const char *dump)
+{
+    int i, level, boots, why;
+    uint8_t full_volts;
+    FILE *f;
+
+    fresh_cell();
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);            // first boot, saves the defaults
+    host_eeprom[OPT_modegroup] = 1;
+    host_run(10.0, 1.0);
+    for (i = 0; i < STATS_CLICKS; i++)
+        host_run(0.1, 1.0);
+    host_run(0.1, STATS_MINUTES * 60 + 10.0);
+    level = modegroups[(modegroup << 3) + mode_idx];
+    full_volts = host_eeprom[STAT_minvolt];
+
+    for (i = 0; i < STAT_LEVELS; i++)
+        check(stat_count(STAT_minutes + 2 * i) ==
+              (i == level - 1 ? STATS_MINUTES : 0),
+              "%d minutes at level %d, %d minutes on at level %d",
+              stat_count(STAT_minutes + 2 * i), i + 1, STATS_MINUTES, level);
+    check(full_volts != 0xff, "no voltage reading saved");
+
+    rest_volts(2.9);
+    why = host_run(0.1, 60.0);
+    boots = stat_count(STAT_boots) * 8 +
+        __builtin_popcount(~host_eeprom[STAT_boots_ones] & 0xff);
+
+    check(why == HOST_OFF, "a flat cell didn't shut the light off");
+    check(boots == STATS_CLICKS + 4, "%d boots counted, %d clicks",
+          boots, STATS_CLICKS + 4);
+    check(stat_count(STAT_stepdowns) >= 1, "no step downs counted");
+    check(stat_count(STAT_shutdowns) == 1, "%d shutdowns counted",
+          stat_count(STAT_shutdowns));
+    check(host_eeprom[STAT_minvolt] < full_volts,
+          "lowest voltage %d, %d on a full cell",
+          host_eeprom[STAT_minvolt], full_volts);
+    printf("stats: %d boots, %d minutes at level %d, %d step downs, "
+           "%d shutdown, lowest ADC %d\n", boots,
+           stat_count(STAT_minutes + 2 * (level - 1)), level,
+           stat_count(STAT_stepdowns), stat_count(STAT_shutdowns),
+           host_eeprom[STAT_minvolt]);
+
+    if (dump) {
+        f = fopen(dump, "wb");
+        check(f && fwrite(host_eeprom, 1, HOST_EEPSIZE, f) == HOST_EEPSIZE,
+              "can't write %s", dump);
+        if (f)
+            fclose(f);
+    }
+    fresh_cell();
+}
+
+/* USE_DELAY_CAL, on a chip whose RC oscillator runs 8% fast: the
+ * first power on measures the delay loop count for 4 ms against the
+ * watchdog, a quarter second before the light comes on, and stores
+ * it.  After that it is read back, not measured again, whatever it
+ * is; one more than 25% off F_CPU is kept, but the delays go by
+ * BOGOMIPS (950) then.
+ */
+#define CAL_RC          1.08
+
+static uint16_t
+cal_cells(void)
+{
+    return host_eeprom[OPT_delay_cal] | (host_eeprom[OPT_delay_cal + 1] << 8);
+}
+
+static void
+check_delay_cal(void)
+{
+    double ms;
+    uint16_t n;
+
+    fresh_cell();
+    host_rc = CAL_RC;
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    host_run(10.0, 1.0);
+    n = cal_cells();
+    ms = delay_loops * 4 * 1000.0 / host_cpu_hz();
+
+    check(n == delay_loops, "stored %d, going by %d", n, delay_loops);
+    check(ms > 3.96 && ms < 4.04, "a \"4 ms\" delay is %.3f ms", ms);
+    check(host_first_light > 0.25 * host_cpu_hz(),
+          "first light %.0f cycles after power on, not measured first",
+          host_first_light);
+    printf("delay cal: %d loops, %.3f ms steps at %.2f MHz, first light "
+           "%.0f ms\n", n, ms, host_cpu_hz() / 1e6,
+           host_first_light * 1000 / host_cpu_hz());
+
+    host_run(10.0, 1.0);
+    check(host_first_light < 0.01 * host_cpu_hz(),
+          "measured again, first light after %.0f cycles", host_first_light);
+    check(cal_cells() == n && delay_loops == n,
+          "stored %d and going by %d, measured %d", cal_cells(),
+          delay_loops, n);
+
+    host_eeprom[OPT_delay_cal] = 5000 & 0xff;
+    host_eeprom[OPT_delay_cal + 1] = 5000 >> 8;
+    host_run(10.0, 1.0);
+    check(delay_loops == 5000, "stored 5000, going by %d", delay_loops);
+
+    host_eeprom[OPT_delay_cal] = 100;
+    host_eeprom[OPT_delay_cal + 1] = 0;
+    host_run(10.0, 1.0);
+    check(delay_loops == 950 * 4, "stored 100, going by %d", delay_loops);
+    check(cal_cells() == 100, "stored 100, then %d", cal_cells());
+
+    host_rc = 1.0;
+    memset(host_eeprom, 0xff, sizeof host_eeprom);
+    fresh_cell();
+}
+
+int
+main(int argc, char **argv)
+{
+    const char *dump = NULL;
+
+    if (argc == 3 && strcmp(argv[1], "-e") == 0)
+        dump = argv[2];
+    else if (argc != 1) {
+        fprintf(stderr, "usage: simple-host [-e dump]\n");
+        return 1;
+    }
+
+    check_clicks();
+    check_first_light();
+    if (&delay_loops)
+        check_delay_cal();
+    if (stat_add)
+        check_stats(dump);
+
+    printf("%d checks, %d failed\n", checks, failed);
+    return failed ? 1 : 0;
+}
+
+/* THE END */
@@ -0,0 +1,12 @@
+#ifndef HOST_UTIL_DELAY_H
+#define HOST_UTIL_DELAY_H
+/*
+ * Host stand-in for <util/delay.h>, see ../README.md
+ */
+
+#include <util/delay_basic.h>
+
+#define _delay_ms(ms)   host_delay_cycles((uint32_t) ((ms) * (F_CPU / 1000)))
+#define _delay_us(us)   host_delay_cycles((uint32_t) ((us) * (F_CPU / 1000000)))
+
+#endif  // HOST_UTIL_DELAY_H
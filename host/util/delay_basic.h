@@ -0,0 +1,15 @@
+#ifndef HOST_UTIL_DELAY_BASIC_H
+#define HOST_UTIL_DELAY_BASIC_H
+/*
+ * Host stand-in for <util/delay_basic.h>, see ../README.md
+ * A busy wait just moves simulated time along.
+ */
+
+#include <stdint.h>
+
+void host_delay_cycles(uint32_t cycles);
+
+#define _delay_loop_1(n)    host_delay_cycles(3 * ((n) ? (n) : 256UL))
+#define _delay_loop_2(n)    host_delay_cycles(4 * ((n) ? (n) : 65536UL))
+
+#endif  // HOST_UTIL_DELAY_BASIC_H
@@ -76,8 +76,19 @@
 /* Here is the original set --
  * 0.4, 2.7, 12.5, 25, 42, 50, 100
  */
+// Building with RAMP_ARGS set in the Makefile replaces these
+// with a table made by ../bin/ramp_calc.py
+#ifdef USE_RAMP_H
+#include "ramp.h"
+#if RAMP_FRAC_BITS
+#error "no PWM dithering here, leave the fraction bits out of RAMP_ARGS"
+#endif
+#define RAMP_FET   RAMP_PWM
+#else
 #define RAMP_SIZE  7
 #define RAMP_FET   1,7,32,63,107,127,255
+#define RAMP_PHASE_LEVELS 2
+#endif
 
 /* The BLF offers 7 levels, sort of as follows:
  * 0.13, 0.5, 5, 17, 24, 43, 100
@@ -125,8 +136,40 @@
 #define OWN_DELAY           // Don't use stock delay functions.
 #define USE_DELAY_4MS
 #define USE_DELAY_S         // Also use _delay_s(), not just _delay_ms()
+// Time the delay loop against the watchdog at first power on
+// (see tk-delay.h), instead of going by BOGOMIPS
+// Opt-in, off by default: doesn't fit in 1K along with the rest, about
+// 110 bytes, so the light as shipped goes by BOGOMIPS.  host/ checks it
+// (simple-opt-host)
+//#define USE_DELAY_CAL
 #include "tk-delay.h"
 
+// Let EEPROM writes finish in the background (uses 18 bytes of RAM)
+#define USE_EEPROM_QUEUE
+#include "tk-eeprom.h"
+
+// Keep usage statistics in EEPROM (see tk-stats.h)
+// Opt-in, off by default: doesn't fit in 1K along with the rest, about
+// 240 bytes, so the light as shipped keeps none.  host/ checks it
+// (simple-opt-host)
+//#define USE_STATS
+#ifdef USE_STATS
+#include "tk-stats.h"
+// Passes through the main loop (_delay_4ms(125)) in a minute.  Without
+// the calibration a "4 ms" is BOGOMIPS*4 delay loops of 4 clocks, 3.2 ms
+// at 4.8 MHz, so a minute is 152 passes, not 120.
+#ifdef USE_DELAY_CAL
+#define STAT_TICKS  120
+#else
+#define STAT_TICKS  ((60UL * F_CPU + 125UL * BOGOMIPS * 8) / (125UL * BOGOMIPS * 16))
+#endif
+#endif
+
+// Change PWM mode and level only between PWM periods
+// Doesn't fit in 1K along with the rest, about 35 bytes
+//#define USE_PWM_SYNC
+#include "tk-pwm.h"
+
 // This also pulls in tk-calibration.h
 #include "tk-voltage.h"
 
@@ -185,9 +228,6 @@ PROGMEM const uint8_t modegroups[] = {
      1,  2,  3,  5,  7,  0,  0,  0,
 };
 
-// Modes (gets set when the light starts up based on saved config values)
-uint8_t modes[8];  // make sure this is long enough...
-
 /* Here is where we save the value of mode_idx
  * We don't just save it, but we fool around using the
  * entire first half of the EEPROM to perform wear
@@ -201,22 +241,27 @@ save_mode() {  // save the current mode index (with wear leveling)
 
     eepos = (eepos+1) & (WEAR_LVL_LEN-1);  // wear leveling, use next cell
 
-    eeprom_write_byte((uint8_t *)(eepos), mode_idx);  // save current state
-    eeprom_write_byte((uint8_t *)(oldpos), 0xff);     // erase old state
+    eep_write(eepos, mode_idx);  // save current state
+    eep_write(oldpos | EEP_ERASE, 0xff);  // erase old state
 }
 
 #define OPT_modegroup (EEPSIZE-1)
 #define OPT_memory (EEPSIZE-2)
 #define OPT_mode_override (EEPSIZE-3)
+#define OPT_delay_cal (EEPSIZE-5)   // two cells, low byte first
+
+#if defined(USE_STATS) && STAT_END > OPT_delay_cal
+#error "tk-stats.h runs into the OPT_* cells"
+#endif
 
 void
 save_state() {  // central method for writing complete state
 	/* tjt - This saves the value of mode_idx */
     save_mode();
 
-    eeprom_write_byte((uint8_t *)OPT_modegroup, modegroup);
-    eeprom_write_byte((uint8_t *)OPT_memory, memory);
-    eeprom_write_byte((uint8_t *)OPT_mode_override, mode_override);
+    eep_write(OPT_modegroup, modegroup);
+    eep_write(OPT_memory, memory);
+    eep_write(OPT_mode_override, mode_override);
 }
 
 /* tjt - this gets called when we decide this is the first
@@ -279,6 +324,32 @@ restore_state() {
 		reset_state();
 }
 
+#ifdef USE_DELAY_CAL
+/* The delay loop count from the first power on, or measure it now
+ * if there isn't one.  A chip erase (reflashing) erases it, so the
+ * measurement is done over then.  A count that is way off is kept
+ * too, so we don't measure again at every power on, but we go by
+ * BOGOMIPS instead.  (A measurement never comes out as 0xffff.)
+ */
+static inline void
+restore_delay() {
+    uint16_t n = eeprom_read_word((const uint16_t *)OPT_delay_cal);
+
+    if (n == 0xffff) {
+        n = delay_measure();
+        // Not through the queue: it doesn't drain before sei(), and
+        // restore_state() reads the EEPROM right after us
+        eep_start(OPT_delay_cal, n, 0);
+        while (EECR & (1 << EEPE)) ;
+        eep_start(OPT_delay_cal + 1, n >> 8, 0);
+        while (EECR & (1 << EEPE)) ;
+    }
+    if (n < DELAY_CAL_MIN || n > DELAY_CAL_MAX)
+        n = BOGOMIPS*4;
+    delay_loops = n;
+}
+#endif
+
 static inline void
 next_mode() {
     mode_idx += 1;
@@ -289,11 +360,16 @@ next_mode() {
 
 /* tjt - this is called once, early in main()
  * A more apt name would be "setup_modes()" perhaps
- * In particular, based on "modegrup" this copies the 8 values
- * for that selection into the "modes" array.
+ * In particular, based on "modegrup" it counts the
+ * modes in that selection.
  *
  * The value of "modegroup" is set in restore_state()
  * which gets called just before this routine gets called.
+ *
+ * The modes themselves used to get copied into a "modes[8]"
+ * array, but that is 8 of our 64 bytes of RAM holding
+ * something that is already in flash.  Now get_mode()
+ * reads them from the table as needed.
  */
 void
 count_modes() {
@@ -303,7 +379,6 @@ count_modes() {
      * (this matters because we have more than one set of modes to choose
      *  from, so we need to count at runtime)
      */
-    uint8_t *dest = modes;
     const uint8_t *src = modegroups + (modegroup<<3);
     uint8_t count;
 
@@ -312,32 +387,39 @@ count_modes() {
     // No, how about actually counting the modes instead?
     // (in case anyone changes the mode groups above so they don't form a triangle)
 
-    for(count=0; (count<8) && pgm_read_byte(src); count++, src++ ) {
-		*dest++ = pgm_read_byte(src);
-    }
+    for(count=0; (count<8) && pgm_read_byte(src); count++, src++ )
+        ;
 
     solid_modes = count;
 
 }	/* End of count_modes() */
 
+// The value of mode "idx" in the current group
+static inline uint8_t
+get_mode ( uint8_t idx ) {
+    return pgm_read_byte(modegroups + (modegroup<<3) + idx);
+}
+
 /* Called only by set_level() just below
  */
 static inline void
-set_output ( uint8_t pwm1 ) {
+set_output ( uint8_t mode, uint8_t pwm1 ) {
     /* This is no longer needed since we always use PHASE mode.
     // Need PHASE to properly turn off the light
     if ((pwm1==0) && (pwm2==0)) {
         TCCR0A = PHASE;
     }
     */
-    PWM_LVL = pwm1;
+    // Both at once, at the end of a PWM period (tk-pwm.h)
+    set_pwm(mode, pwm1);
 }
 
 void
 set_level(uint8_t level) {
-    TCCR0A = PHASE;
+    uint8_t mode = PHASE;
+
     if (level == 0) {
-        set_output(0);
+        set_output(mode, 0);
     } else {
         //level -= 1;
         /* apparently not needed on the newer drivers
@@ -347,12 +429,12 @@ set_level(uint8_t level) {
             TCCR0B = 0x02;
         }
         */
-        if (level > 2) {
+        if (level > RAMP_PHASE_LEVELS) {
             // divide PWM speed by 2 for moon and low,
             // because the nanjg 105d chips are SLOW
-            TCCR0A = FAST;
+            mode = FAST;
         }
-        set_output ( pgm_read_byte(ramp_FET + level - 1) );
+        set_output ( mode, pgm_read_byte(ramp_FET + level - 1) );
     }
 }
 
@@ -424,6 +506,15 @@ main(void)
     // Set timer to do PWM for correct output pin and set prescaler timing
     TCCR0B = 0x01; // pre-scaler for timer (1 => 1, 2 => 8, 3 => 64...)
 
+#ifdef USE_DELAY_CAL
+    // Before the interrupts and the PWM, see delay_measure()
+    restore_delay();
+#endif
+
+#if defined(USE_EEPROM_QUEUE) || defined(USE_PWM_SYNC)
+    sei();      // the write queue and PWM changes run from interrupts
+#endif
+
     // Read config values and saved state
     restore_state();
 
@@ -457,6 +548,30 @@ main(void)
     }
 
     long_press = 0;
+
+    uint8_t output;
+    uint8_t actual_level;
+
+    output = get_mode(mode_idx);
+    actual_level = output;
+
+    // handle mode overrides, like mode group selection and temperature calibration
+    if (mode_override) {
+        // do nothing; mode is already set
+        //mode_idx = mode_override;
+        fast_presses = 0;
+        output = mode_idx;
+    }
+
+    // Light up a solid mode right away, before saving the mode and
+    // starting the ADC.  The main loop sets it again, which is harmless.
+    // (not for config mode, which starts out dark)
+    if (fast_presses <= 9 && output <= RAMP_SIZE)
+        set_mode(actual_level);
+
+#ifdef USE_STATS
+    stat_boot();
+#endif
     save_mode();
 
     // Turn features on or off as needed
@@ -467,9 +582,6 @@ main(void)
     ADC_off();
     #endif
 
-    uint8_t output;
-    uint8_t actual_level;
-
 #ifdef VOLTAGE_MON
     uint8_t lowbatt_cnt = 0;
     uint8_t i = 0;
@@ -477,18 +589,9 @@ main(void)
     // Make sure voltage reading is running for later
     ADCSRA |= (1 << ADSC);
 #endif
-
-    //output = pgm_read_byte(modes + mode_idx);
-    output = modes[mode_idx];
-    actual_level = output;
-
-    // handle mode overrides, like mode group selection and temperature calibration
-    if (mode_override) {
-        // do nothing; mode is already set
-        //mode_idx = mode_override;
-        fast_presses = 0;
-        output = mode_idx;
-    }
+#ifdef USE_STATS
+    uint8_t stat_ticks = 0;
+#endif
 
     while(1) {
         if (fast_presses > 9) {  // Config mode
@@ -505,7 +608,7 @@ main(void)
 
             toggle(&memory, 2);
 
-            output = modes[mode_idx];
+            output = get_mode(mode_idx);
             actual_level = output;
         }
 
@@ -545,6 +648,13 @@ main(void)
             // just sleep.
             _delay_4ms(125);
 
+#ifdef USE_STATS
+            if (++stat_ticks >= STAT_TICKS) {
+                stat_ticks = 0;
+                stat_minute(actual_level);
+            }
+#endif
+
             // If we got this far, the user has stopped fast-pressing.
             // So, don't enter config mode.
             //fast_presses = 0;
@@ -556,6 +666,9 @@ main(void)
 #ifdef VOLTAGE_MON
         if (ADCSRA & (1 << ADIF)) {  // if a voltage reading is ready
             voltage = ADCH;  // get the waiting value
+#ifdef USE_STATS
+            stat_voltage(voltage);
+#endif
             // See if voltage is lower than what we were looking for
             if (voltage < ADC_LOW) {
                 lowbatt_cnt ++;
@@ -582,10 +695,19 @@ main(void)
                     //actual_level = 0;  // unnecessary; we never leave this clause
                     // Turn off the light
                     set_level(0);
+                    pwm_wait();
+#ifdef USE_STATS
+                    stat_add(STAT_shutdowns);
+#endif
+                    // A write still in the queue would be lost
+                    eep_flush();
                     // Power down as many components as possible
                     set_sleep_mode(SLEEP_MODE_PWR_DOWN);
                     sleep_mode();
                 }
+#ifdef USE_STATS
+                stat_add(STAT_stepdowns);
+#endif
                 set_mode(actual_level);
                 output = actual_level;
                 //save_mode();  // we didn't actually change the mode
@@ -45,10 +45,46 @@ void _delay_zero() {
 }
 #endif
 #ifdef USE_DELAY_4MS
+#ifdef USE_DELAY_CAL
+/*
+ * BOGOMIPS is a guess, and the RC oscillator is only trimmed to 10%
+ * at the factory, so delays drift from one driver to the next.
+ * delay_measure() times the oscillator against the watchdog's own
+ * one (tk-wdt.h): timer 0 overflows (256 clocks) in one 128 ms
+ * watchdog period, twice over, is the number of delay loop passes
+ * (4 clocks) in 4 ms.  The firmware keeps that in EEPROM and sets
+ * delay_loops from it at power on (see restore_delay() in simple.c).
+ */
+#include "tk-wdt.h"
+
+// What delay_measure() can sensibly come back with, F_CPU +- 25%
+#define DELAY_CAL_MIN   (F_CPU / 1000 * 3 / 4)
+#define DELAY_CAL_MAX   (F_CPU / 1000 * 5 / 4)
+
+uint16_t delay_loops;           // delay loop passes in 4 ms, set at power on
+
+/* Takes a quarter second, see wdt_count() for how to call it
+ */
+uint16_t delay_measure()
+{
+    uint16_t n = wdt_count((1 << WDP1) | (1 << WDP0)) * 2;  // 128 ms
+
+#if WDT_HZ != 128000
+    n = (uint32_t) n * 128000 / WDT_HZ;
+#endif
+    return n;
+}
+
+void _delay_4ms(uint8_t n)  // because it saves a bit of ROM space to do it this way
+{
+    while(n-- > 0) _delay_loop_2(delay_loops);
+}
+#else
 void _delay_4ms(uint8_t n)  // because it saves a bit of ROM space to do it this way
 {
     while(n-- > 0) _delay_loop_2(BOGOMIPS*4);
 }
+#endif  // USE_DELAY_CAL
 #endif
 #ifdef USE_DELAY_S
 void _delay_s()  // because it saves a bit of ROM space to do it this way
@@ -0,0 +1,127 @@
+#ifndef TK_EEPROM_H
+#define TK_EEPROM_H
+/*
+ * Background EEPROM writes for attiny13a.
+ *
+ * Each EEPROM byte takes about 3.4 ms to erase and write, and
+ * eeprom_write_byte() waits for the previous write to finish before
+ * starting the next one.  save_state() writes five bytes, so the
+ * light sat there dark for 15 ms or more before it came on.
+ *
+ * With USE_EEPROM_QUEUE, writes go into a small queue instead, and
+ * the EEPROM ready interrupt hands them to the hardware one at a
+ * time.  The caller gets on with turning on the light.
+ *
+ * The top two bits of the address pick the programming mode.  Plain
+ * addresses get the usual erase and write.  EEP_ERASE just sets the
+ * cell to 0xff, and EEP_WRITE only clears bits, so it is only useful
+ * on a cell that was erased earlier.  Either one takes 1.8 ms.
+ *
+ * Interrupts must be enabled (sei) for the queue to drain.  Don't
+ * read the EEPROM while writes are pending, call eep_flush() first.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include "tk-attiny.h"
+
+#define EEP_ERASE   0x40    // erase only, leaves 0xff
+#define EEP_WRITE   0x80    // write only, can only clear bits
+
+/* Start a write, the EEPROM must be idle.
+ * EEPM1:0 are bits 5:4 of EECR, in the address they are bits 7:6.
+ */
+static inline void
+eep_start(uint8_t addr, uint8_t data, uint8_t eecr)
+{
+    EEARL = addr & (EEPSIZE-1);
+    EEDR = data;
+    EECR = eecr | ((addr >> 2) & ((1 << EEPM1) | (1 << EEPM0))) | (1 << EEMPE);
+    EECR |= (1 << EEPE);    // must follow EEMPE within 4 cycles
+}
+
+#ifdef USE_EEPROM_QUEUE
+
+#ifndef EEQ_LEN
+#define EEQ_LEN 8           // must be a power of 2, holds EEQ_LEN-1 writes
+#endif
+
+uint8_t eeq_addr[EEQ_LEN];
+uint8_t eeq_data[EEQ_LEN];
+volatile uint8_t eeq_head;  // next free slot
+volatile uint8_t eeq_tail;  // next write to start
+
+/* This fires over and over as long as EERIE is set and the EEPROM
+ * is idle, so it starts each write as soon as the last one is done.
+ * When the queue is empty it turns itself off.
+ */
+ISR(EE_RDY_vect)
+{
+    uint8_t t = eeq_tail;
+
+    if (t == eeq_head) {
+        EECR = 0;
+        return;
+    }
+
+    eep_start(eeq_addr[t], eeq_data[t], (1 << EERIE));
+    eeq_tail = (t+1) & (EEQ_LEN-1);
+}
+
+void
+eep_write(uint8_t addr, uint8_t data)
+{
+    uint8_t h = eeq_head;
+    uint8_t next = (h+1) & (EEQ_LEN-1);
+
+    // queue full, wait for the interrupt to make room
+    while (next == eeq_tail) ;
+
+    eeq_addr[h] = addr;
+    eeq_data[h] = data;
+    eeq_head = next;
+
+    // kick it off (or keep it going), this is a single sbi
+    EECR |= (1 << EERIE);
+}
+
+// wait for all pending writes to finish
+#define eep_flush()     while (EECR & (1 << EERIE))
+
+#else
+
+// The plain blocking version, like eeprom_write_byte() but with modes
+void
+eep_write(uint8_t addr, uint8_t data)
+{
+    uint8_t sreg;
+
+    while (EECR & (1 << EEPE)) ;
+    // an interrupt between EEMPE and EEPE would spoil the write
+    sreg = SREG;
+    cli();
+    eep_start(addr, data, 0);
+    SREG = sreg;
+}
+
+#define eep_flush()
+
+#endif  // USE_EEPROM_QUEUE
+
+#endif  // TK_EEPROM_H
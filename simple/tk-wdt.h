@@ -0,0 +1,68 @@
+#ifndef TK_WDT_H
+#define TK_WDT_H
+/*
+ * Time the system clock against the watchdog oscillator.
+ *
+ * The watchdog runs off its own 128 kHz oscillator, which the system
+ * clock prescaler and OSCCAL don't touch, so counting clocks over one
+ * watchdog period tells us how fast the RC oscillator really runs.
+ * It isn't trimmed, and the datasheet only gives typical curves for
+ * it: a few percent over voltage and temperature, and nothing on how
+ * much it varies between chips.  So this catches an RC oscillator
+ * that is well off, but is only as good as the watchdog it goes by.
+ * Set WDT_HZ if you have measured yours.
+ *
+ * Copyright (C) 2026 the contributors to this repository (see git log)
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <avr/wdt.h>
+
+#ifndef WDT_HZ
+#define WDT_HZ  128000UL
+#endif
+
+/* Timer 0 overflows (256 clocks) in one watchdog period, wdp is the
+ * WDP bits for it.  Call it with interrupts off (the watchdog is set
+ * up to interrupt, and we only look at the flag) and timer 0 counting
+ * at clk/1 with TOP at 0xff.  The watchdog is off again when done.
+ */
+uint16_t wdt_count(uint8_t wdp)
+{
+    uint16_t n = 0;
+
+    wdt_reset();
+    WDTCR |= (1 << WDCE) | (1 << WDE);  // Start timed sequence
+    WDTCR = (1 << WDTIF) | (1 << WDTIE) | wdp;
+
+    // Line up with one time-out, then count up to the next
+    while (! (WDTCR & (1 << WDTIF)))
+        ;
+    WDTCR |= (1 << WDTIF);
+    TIFR0 = (1 << TOV0);
+    while (! (WDTCR & (1 << WDTIF))) {
+        if (TIFR0 & (1 << TOV0)) {
+            TIFR0 = (1 << TOV0);
+            n++;
+        }
+    }
+
+    WDTCR |= (1 << WDCE) | (1 << WDE);
+    WDTCR = 0;                          // watchdog off again
+    return n;
+}
+
+#endif  // TK_WDT_H